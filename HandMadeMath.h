@@ -566,6 +566,315 @@ HMM_INLINE float HMM_PREFIX(PowerF)(float Base, float Exponent)
     return (Result);
 }
 
+/*
+ * Polynomial sin/cos, atan2 and exp, for arrays. Cephes-style range reduction
+ * and minimax polynomials, the same steps in the scalar and the SSE version.
+ * They trade libm's last bit or so and its special cases for speed. Max
+ * errors against double precision, as measured by bench/hmm_bench --accuracy:
+ *
+ *   SinCos  |x| <= 8192         absolute error below 1e-7
+ *   ATan2   finite inputs       absolute error below 3e-7 (about 1 ulp at 2)
+ *   Exp     -87.3 <= x <= 88.3  relative error below 1e-7 (about 1 ulp)
+ *
+ * Past |x| = 8192 the sin/cos range reduction loses bits, Exp clamps its
+ * input to the range above and ATan2 doesn't handle infinities or NaNs.
+ * atan2(±0, ±0) follows libm.
+ */
+
+#define HMM_APPROX_TWO_OVER_PI 0.636619772367581f
+/* pi/2 in three parts, so multiples of the first two are exact (Cody-Waite) */
+#define HMM_APPROX_PI_OVER_2_A 1.5703125f
+#define HMM_APPROX_PI_OVER_2_B 4.837512969970703125e-4f
+#define HMM_APPROX_PI_OVER_2_C 7.54978995489188216e-8f
+
+#define HMM_APPROX_SIN_1 -1.6666654611e-1f
+#define HMM_APPROX_SIN_2  8.3321608736e-3f
+#define HMM_APPROX_SIN_3 -1.9515295891e-4f
+#define HMM_APPROX_COS_1  4.166664568298827e-2f
+#define HMM_APPROX_COS_2 -1.388731625493765e-3f
+#define HMM_APPROX_COS_3  2.443315711809948e-5f
+
+#define HMM_APPROX_TAN_PI_OVER_8 0.4142135623730950f
+#define HMM_APPROX_ATAN_1  8.05374449538e-2f
+#define HMM_APPROX_ATAN_2 -1.38776856032e-1f
+#define HMM_APPROX_ATAN_3  1.99777106478e-1f
+#define HMM_APPROX_ATAN_4 -3.33329491539e-1f
+
+#define HMM_APPROX_EXP_MIN -87.3365447505531f
+#define HMM_APPROX_EXP_MAX  88.3762626647949f
+#define HMM_APPROX_LOG2E 1.44269504088896341f
+/* ln 2 in two parts */
+#define HMM_APPROX_LN2_A 0.693359375f
+#define HMM_APPROX_LN2_B -2.12194440e-4f
+#define HMM_APPROX_EXP_1 1.9875691500e-4f
+#define HMM_APPROX_EXP_2 1.3981999507e-3f
+#define HMM_APPROX_EXP_3 8.3334519073e-3f
+#define HMM_APPROX_EXP_4 4.1665795894e-2f
+#define HMM_APPROX_EXP_5 1.6666665459e-1f
+#define HMM_APPROX_EXP_6 5.0000001201e-1f
+
+/* Round to nearest, ties away from zero */
+HMM_INLINE int HMM_PREFIX(ApproxRound)(float Float)
+{
+    return (int)(Float + (Float < 0.0f ? -0.5f : 0.5f));
+}
+
+COVERAGE(HMM_SinCosApproxF, 1)
+HMM_INLINE void HMM_PREFIX(SinCosApproxF)(float Radians, float *Sin, float *Cos)
+{
+    ASSERT_COVERED(HMM_SinCosApproxF);
+
+    int Quadrant = HMM_PREFIX(ApproxRound)(Radians * HMM_APPROX_TWO_OVER_PI);
+    float J = (float)Quadrant;
+    float R = ((Radians - J * HMM_APPROX_PI_OVER_2_A) - J * HMM_APPROX_PI_OVER_2_B) - J * HMM_APPROX_PI_OVER_2_C;
+    float R2 = R * R;
+
+    float S = R + R * R2 * (HMM_APPROX_SIN_1 + R2 * (HMM_APPROX_SIN_2 + R2 * HMM_APPROX_SIN_3));
+    float C = (1.0f - 0.5f * R2) + R2 * R2 * (HMM_APPROX_COS_1 + R2 * (HMM_APPROX_COS_2 + R2 * HMM_APPROX_COS_3));
+
+    /* Quadrant 1 is (cos, -sin), 2 is (-sin, -cos), 3 is (-cos, sin) */
+    float SinResult = (Quadrant & 1) ? C : S;
+    float CosResult = (Quadrant & 1) ? S : C;
+    *Sin = (Quadrant & 2) ? -SinResult : SinResult;
+    *Cos = ((Quadrant + 1) & 2) ? -CosResult : CosResult;
+}
+
+COVERAGE(HMM_ATan2ApproxF, 1)
+HMM_INLINE float HMM_PREFIX(ATan2ApproxF)(float Y, float X)
+{
+    ASSERT_COVERED(HMM_ATan2ApproxF);
+
+    float AbsX = X < 0.0f ? -X : X;
+    float AbsY = Y < 0.0f ? -Y : Y;
+    float Max = HMM_MAX(AbsX, AbsY);
+    float T = Max != 0.0f ? HMM_MIN(AbsX, AbsY) / Max : 0.0f;
+
+    /* atan(t) on [0, 1], as pi/4 + atan((t - 1) / (t + 1)) above tan(pi/8) */
+    float Offset = 0.0f;
+    if (T > HMM_APPROX_TAN_PI_OVER_8)
+    {
+        T = (T - 1.0f) / (T + 1.0f);
+        Offset = HMM_PI32 / 4.0f;
+    }
+    float Z = T * T;
+    float Result = Offset + ((((HMM_APPROX_ATAN_1 * Z + HMM_APPROX_ATAN_2) * Z + HMM_APPROX_ATAN_3) * Z + HMM_APPROX_ATAN_4) * Z * T + T);
+
+    if (AbsY > AbsX)
+    {
+        Result = HMM_PI32 / 2.0f - Result;
+    }
+    /* By the sign bits, so -0 counts as negative like in atan2f */
+    union { float Float; unsigned int Bits; } SignX, SignY;
+    SignX.Float = X;
+    SignY.Float = Y;
+    if (SignX.Bits >> 31)
+    {
+        Result = HMM_PI32 - Result;
+    }
+    return (SignY.Bits >> 31) ? -Result : Result;
+}
+
+COVERAGE(HMM_ExpApproxF, 1)
+HMM_INLINE float HMM_PREFIX(ExpApproxF)(float Float)
+{
+    ASSERT_COVERED(HMM_ExpApproxF);
+
+    float X = HMM_MIN(HMM_MAX(Float, HMM_APPROX_EXP_MIN), HMM_APPROX_EXP_MAX);
+    int N = HMM_PREFIX(ApproxRound)(X * HMM_APPROX_LOG2E);
+    float R = (X - (float)N * HMM_APPROX_LN2_A) - (float)N * HMM_APPROX_LN2_B;
+
+    float P = ((((HMM_APPROX_EXP_1 * R + HMM_APPROX_EXP_2) * R + HMM_APPROX_EXP_3) * R + HMM_APPROX_EXP_4) * R + HMM_APPROX_EXP_5) * R + HMM_APPROX_EXP_6;
+    float E = P * R * R + R + 1.0f;
+
+    /* Times 2^N, straight into the exponent bits */
+    union { int Bits; float Float; } Scale;
+    Scale.Bits = (N + 127) << 23;
+    return E * Scale.Float;
+}
+
+#ifdef HANDMADE_MATH__USE_SSE
+
+/* The SSE versions, 4 lanes each. Rounding is to nearest even here instead
+ * of away from zero, which only matters exactly halfway between quadrants. */
+
+HMM_INLINE __m128 HMM_PREFIX(SelectPS)(__m128 Mask, __m128 IfTrue, __m128 IfFalse)
+{
+    return _mm_or_ps(_mm_and_ps(Mask, IfTrue), _mm_andnot_ps(Mask, IfFalse));
+}
+
+HMM_INLINE void HMM_PREFIX(SinCosPS)(__m128 Radians, __m128 *Sin, __m128 *Cos)
+{
+    __m128i Quadrant = _mm_cvtps_epi32(_mm_mul_ps(Radians, _mm_set1_ps(HMM_APPROX_TWO_OVER_PI)));
+    __m128 J = _mm_cvtepi32_ps(Quadrant);
+    __m128 R = _mm_sub_ps(Radians, _mm_mul_ps(J, _mm_set1_ps(HMM_APPROX_PI_OVER_2_A)));
+    R = _mm_sub_ps(R, _mm_mul_ps(J, _mm_set1_ps(HMM_APPROX_PI_OVER_2_B)));
+    R = _mm_sub_ps(R, _mm_mul_ps(J, _mm_set1_ps(HMM_APPROX_PI_OVER_2_C)));
+    __m128 R2 = _mm_mul_ps(R, R);
+
+    __m128 S = _mm_add_ps(_mm_mul_ps(R2, _mm_set1_ps(HMM_APPROX_SIN_3)), _mm_set1_ps(HMM_APPROX_SIN_2));
+    S = _mm_add_ps(_mm_mul_ps(R2, S), _mm_set1_ps(HMM_APPROX_SIN_1));
+    S = _mm_add_ps(R, _mm_mul_ps(_mm_mul_ps(R, R2), S));
+
+    __m128 C = _mm_add_ps(_mm_mul_ps(R2, _mm_set1_ps(HMM_APPROX_COS_3)), _mm_set1_ps(HMM_APPROX_COS_2));
+    C = _mm_add_ps(_mm_mul_ps(R2, C), _mm_set1_ps(HMM_APPROX_COS_1));
+    C = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), R2)), _mm_mul_ps(_mm_mul_ps(R2, R2), C));
+
+    __m128i One = _mm_set1_epi32(1);
+    __m128i Two = _mm_set1_epi32(2);
+    __m128 Swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(Quadrant, One), One));
+    __m128 SinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(Quadrant, Two), 30));
+    __m128 CosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(Quadrant, One), Two), 30));
+
+    *Sin = _mm_xor_ps(HMM_PREFIX(SelectPS)(Swap, C, S), SinSign);
+    *Cos = _mm_xor_ps(HMM_PREFIX(SelectPS)(Swap, S, C), CosSign);
+}
+
+HMM_INLINE __m128 HMM_PREFIX(ATan2PS)(__m128 Y, __m128 X)
+{
+    __m128 SignBit = _mm_set1_ps(-0.0f);
+    __m128 AbsX = _mm_andnot_ps(SignBit, X);
+    __m128 AbsY = _mm_andnot_ps(SignBit, Y);
+    __m128 Max = _mm_max_ps(AbsX, AbsY);
+    __m128 T = _mm_and_ps(_mm_div_ps(_mm_min_ps(AbsX, AbsY), Max), _mm_cmpneq_ps(Max, _mm_setzero_ps()));
+
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 Big = _mm_cmpgt_ps(T, _mm_set1_ps(HMM_APPROX_TAN_PI_OVER_8));
+    T = HMM_PREFIX(SelectPS)(Big, _mm_div_ps(_mm_sub_ps(T, One), _mm_add_ps(T, One)), T);
+    __m128 Offset = _mm_and_ps(Big, _mm_set1_ps(HMM_PI32 / 4.0f));
+    __m128 Z = _mm_mul_ps(T, T);
+
+    __m128 P = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(HMM_APPROX_ATAN_1), Z), _mm_set1_ps(HMM_APPROX_ATAN_2));
+    P = _mm_add_ps(_mm_mul_ps(P, Z), _mm_set1_ps(HMM_APPROX_ATAN_3));
+    P = _mm_add_ps(_mm_mul_ps(P, Z), _mm_set1_ps(HMM_APPROX_ATAN_4));
+    __m128 Result = _mm_add_ps(Offset, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(P, Z), T), T));
+
+    Result = HMM_PREFIX(SelectPS)(_mm_cmpgt_ps(AbsY, AbsX), _mm_sub_ps(_mm_set1_ps(HMM_PI32 / 2.0f), Result), Result);
+    __m128 XNegative = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(X), 31));
+    Result = HMM_PREFIX(SelectPS)(XNegative, _mm_sub_ps(_mm_set1_ps(HMM_PI32), Result), Result);
+    return _mm_or_ps(Result, _mm_and_ps(SignBit, Y));
+}
+
+HMM_INLINE __m128 HMM_PREFIX(ExpPS)(__m128 Float)
+{
+    __m128 X = _mm_min_ps(_mm_max_ps(Float, _mm_set1_ps(HMM_APPROX_EXP_MIN)), _mm_set1_ps(HMM_APPROX_EXP_MAX));
+    __m128i N = _mm_cvtps_epi32(_mm_mul_ps(X, _mm_set1_ps(HMM_APPROX_LOG2E)));
+    __m128 NFloat = _mm_cvtepi32_ps(N);
+    __m128 R = _mm_sub_ps(X, _mm_mul_ps(NFloat, _mm_set1_ps(HMM_APPROX_LN2_A)));
+    R = _mm_sub_ps(R, _mm_mul_ps(NFloat, _mm_set1_ps(HMM_APPROX_LN2_B)));
+
+    __m128 P = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(HMM_APPROX_EXP_1), R), _mm_set1_ps(HMM_APPROX_EXP_2));
+    P = _mm_add_ps(_mm_mul_ps(P, R), _mm_set1_ps(HMM_APPROX_EXP_3));
+    P = _mm_add_ps(_mm_mul_ps(P, R), _mm_set1_ps(HMM_APPROX_EXP_4));
+    P = _mm_add_ps(_mm_mul_ps(P, R), _mm_set1_ps(HMM_APPROX_EXP_5));
+    P = _mm_add_ps(_mm_mul_ps(P, R), _mm_set1_ps(HMM_APPROX_EXP_6));
+    __m128 E = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(P, R), R), R), _mm_set1_ps(1.0f));
+
+    __m128 Scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(N, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(E, Scale);
+}
+
+#endif
+
+/* The array versions. With SSE the last partial group of 4 goes through a
+ * padded copy, so every element gets the same SSE result. */
+
+COVERAGE(HMM_SinCosFArray, 1)
+HMM_INLINE void HMM_PREFIX(SinCosFArray)(const float *Radians, float *Sin, float *Cos, int Count)
+{
+    ASSERT_COVERED(HMM_SinCosFArray);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 S, C;
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        HMM_PREFIX(SinCosPS)(_mm_loadu_ps(Radians + Index), &S, &C);
+        _mm_storeu_ps(Sin + Index, S);
+        _mm_storeu_ps(Cos + Index, C);
+    }
+
+    if (Index < Count)
+    {
+        float In[4] = {0}, SinOut[4], CosOut[4];
+        for (int Lane = 0; Index + Lane < Count; ++Lane) In[Lane] = Radians[Index + Lane];
+        HMM_PREFIX(SinCosPS)(_mm_loadu_ps(In), &S, &C);
+        _mm_storeu_ps(SinOut, S);
+        _mm_storeu_ps(CosOut, C);
+        for (int Lane = 0; Index + Lane < Count; ++Lane)
+        {
+            Sin[Index + Lane] = SinOut[Lane];
+            Cos[Index + Lane] = CosOut[Lane];
+        }
+    }
+#else
+    for (; Index < Count; ++Index)
+    {
+        HMM_PREFIX(SinCosApproxF)(Radians[Index], &Sin[Index], &Cos[Index]);
+    }
+#endif
+}
+
+COVERAGE(HMM_ATan2FArray, 1)
+HMM_INLINE void HMM_PREFIX(ATan2FArray)(const float *Y, const float *X, float *Out, int Count)
+{
+    ASSERT_COVERED(HMM_ATan2FArray);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        _mm_storeu_ps(Out + Index, HMM_PREFIX(ATan2PS)(_mm_loadu_ps(Y + Index), _mm_loadu_ps(X + Index)));
+    }
+
+    if (Index < Count)
+    {
+        float InY[4] = {0}, InX[4] = {0}, Result[4];
+        for (int Lane = 0; Index + Lane < Count; ++Lane)
+        {
+            InY[Lane] = Y[Index + Lane];
+            InX[Lane] = X[Index + Lane];
+        }
+        _mm_storeu_ps(Result, HMM_PREFIX(ATan2PS)(_mm_loadu_ps(InY), _mm_loadu_ps(InX)));
+        for (int Lane = 0; Index + Lane < Count; ++Lane) Out[Index + Lane] = Result[Lane];
+    }
+#else
+    for (; Index < Count; ++Index)
+    {
+        Out[Index] = HMM_PREFIX(ATan2ApproxF)(Y[Index], X[Index]);
+    }
+#endif
+}
+
+COVERAGE(HMM_ExpFArray, 1)
+HMM_INLINE void HMM_PREFIX(ExpFArray)(const float *In, float *Out, int Count)
+{
+    ASSERT_COVERED(HMM_ExpFArray);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        _mm_storeu_ps(Out + Index, HMM_PREFIX(ExpPS)(_mm_loadu_ps(In + Index)));
+    }
+
+    if (Index < Count)
+    {
+        float Padded[4] = {0}, Result[4];
+        for (int Lane = 0; Index + Lane < Count; ++Lane) Padded[Lane] = In[Index + Lane];
+        _mm_storeu_ps(Result, HMM_PREFIX(ExpPS)(_mm_loadu_ps(Padded)));
+        for (int Lane = 0; Index + Lane < Count; ++Lane) Out[Index + Lane] = Result[Lane];
+    }
+#else
+    for (; Index < Count; ++Index)
+    {
+        Out[Index] = HMM_PREFIX(ExpApproxF)(In[Index]);
+    }
+#endif
+}
+
 
 /*
  * Utility functions
@@ -1643,6 +1952,265 @@ HMM_INLINE hmm_mat4 HMM_PREFIX(LookAt)(hmm_vec3 Eye, hmm_vec3 Center, hmm_vec3 U
     return (Result);
 }
 
+/*
+ * Batched instance transforms: Out[i] = Translate(X, Y, Z) * Rotate(Yaw, Y axis) * Scale(ScaleX, ScaleY, ScaleZ)
+ * for Count instances given as SoA arrays. Yaw is in degrees, like HMM_Rotate,
+ * through the polynomial sin/cos.
+ * With SSE, Out must be 16 byte aligned (it is, for hmm_mat4) and is written
+ * with non-temporal stores, so it doesn't evict the inputs from the cache.
+ */
+
+COVERAGE(HMM_InstanceTransforms, 1)
+HMM_INLINE void HMM_PREFIX(InstanceTransforms)(const float *X, const float *Y, const float *Z,
+                                               const float *ScaleX, const float *ScaleY, const float *ScaleZ,
+                                               const float *Yaw, int Count, hmm_mat4 *Out)
+{
+    ASSERT_COVERED(HMM_InstanceTransforms);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 Zero = _mm_setzero_ps();
+    __m128 One = _mm_set1_ps(1.0f);
+
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m128 SinTheta, CosTheta;
+        HMM_PREFIX(SinCosPS)(_mm_mul_ps(_mm_loadu_ps(Yaw + Index), _mm_set1_ps(HMM_PI32 / 180.0f)), &SinTheta, &CosTheta);
+
+        __m128 SX = _mm_loadu_ps(ScaleX + Index);
+        __m128 SY = _mm_loadu_ps(ScaleY + Index);
+        __m128 SZ = _mm_loadu_ps(ScaleZ + Index);
+
+        /* The only non-zero elements of the first three columns, for all 4 instances */
+        __m128 C0X = _mm_mul_ps(CosTheta, SX);
+        __m128 C0Z = _mm_sub_ps(Zero, _mm_mul_ps(SinTheta, SX));
+        __m128 C2X = _mm_mul_ps(SinTheta, SZ);
+        __m128 C2Z = _mm_mul_ps(CosTheta, SZ);
+
+        /* Transpose into one column per instance */
+        __m128 Low0 = _mm_unpacklo_ps(C0X, Zero);
+        __m128 Low1 = _mm_unpacklo_ps(C0Z, Zero);
+        __m128 High0 = _mm_unpackhi_ps(C0X, Zero);
+        __m128 High1 = _mm_unpackhi_ps(C0Z, Zero);
+        __m128 Column0[4] = { _mm_movelh_ps(Low0, Low1), _mm_movehl_ps(Low1, Low0),
+                              _mm_movelh_ps(High0, High1), _mm_movehl_ps(High1, High0) };
+
+        Low0 = _mm_unpacklo_ps(Zero, SY);
+        High0 = _mm_unpackhi_ps(Zero, SY);
+        __m128 Column1[4] = { _mm_movelh_ps(Low0, Zero), _mm_movehl_ps(Zero, Low0),
+                              _mm_movelh_ps(High0, Zero), _mm_movehl_ps(Zero, High0) };
+
+        Low0 = _mm_unpacklo_ps(C2X, Zero);
+        Low1 = _mm_unpacklo_ps(C2Z, Zero);
+        High0 = _mm_unpackhi_ps(C2X, Zero);
+        High1 = _mm_unpackhi_ps(C2Z, Zero);
+        __m128 Column2[4] = { _mm_movelh_ps(Low0, Low1), _mm_movehl_ps(Low1, Low0),
+                              _mm_movelh_ps(High0, High1), _mm_movehl_ps(High1, High0) };
+
+        __m128 Column3[4] = { _mm_loadu_ps(X + Index), _mm_loadu_ps(Y + Index), _mm_loadu_ps(Z + Index), One };
+        _MM_TRANSPOSE4_PS(Column3[0], Column3[1], Column3[2], Column3[3]);
+
+        for (int Lane = 0; Lane < 4; ++Lane)
+        {
+            _mm_stream_ps((float *)&Out[Index + Lane].Columns[0], Column0[Lane]);
+            _mm_stream_ps((float *)&Out[Index + Lane].Columns[1], Column1[Lane]);
+            _mm_stream_ps((float *)&Out[Index + Lane].Columns[2], Column2[Lane]);
+            _mm_stream_ps((float *)&Out[Index + Lane].Columns[3], Column3[Lane]);
+        }
+    }
+
+    /* Make the streamed stores visible before anyone reads Out */
+    _mm_sfence();
+#endif
+
+    /* Tail (or everything, without SSE) */
+    for (; Index < Count; ++Index)
+    {
+        float SinTheta, CosTheta;
+        HMM_PREFIX(SinCosApproxF)(HMM_PREFIX(ToRadians)(Yaw[Index]), &SinTheta, &CosTheta);
+
+        hmm_mat4 *Result = &Out[Index];
+        *Result = HMM_PREFIX(Mat4)();
+
+        Result->Elements[0][0] = CosTheta * ScaleX[Index];
+        Result->Elements[0][2] = -SinTheta * ScaleX[Index];
+        Result->Elements[1][1] = ScaleY[Index];
+        Result->Elements[2][0] = SinTheta * ScaleZ[Index];
+        Result->Elements[2][2] = CosTheta * ScaleZ[Index];
+
+        Result->Elements[3][0] = X[Index];
+        Result->Elements[3][1] = Y[Index];
+        Result->Elements[3][2] = Z[Index];
+        Result->Elements[3][3] = 1.0f;
+    }
+}
+
+/*
+ * Batched vector operations on SoA arrays: one float array per component,
+ * element i of every array belongs to vector i. With SSE they do 4 vectors
+ * per instruction. A scalar prologue runs until the first array is 16 byte
+ * aligned, so it gets aligned loads and stores, and a scalar tail takes what
+ * is left. The other arrays may have any alignment. Results are the same as
+ * the one-vector functions give.
+ */
+
+COVERAGE(HMM_NormalizeVec2Array, 1)
+HMM_INLINE void HMM_PREFIX(NormalizeVec2Array)(float *X, float *Y, int Count)
+{
+    ASSERT_COVERED(HMM_NormalizeVec2Array);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index < Count && ((size_t)(X + Index) & 15); ++Index)
+    {
+        hmm_vec2 Result = HMM_PREFIX(NormalizeVec2)(HMM_PREFIX(Vec2)(X[Index], Y[Index]));
+        X[Index] = Result.X;
+        Y[Index] = Result.Y;
+    }
+
+    __m128 Zero = _mm_setzero_ps();
+    __m128 One = _mm_set1_ps(1.0f);
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m128 VX = _mm_load_ps(X + Index);
+        __m128 VY = _mm_loadu_ps(Y + Index);
+        __m128 Length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(VX, VX), _mm_mul_ps(VY, VY)));
+
+        /* Zero length vectors stay zero, rather than becoming 0/0 */
+        __m128 InverseLength = _mm_and_ps(_mm_div_ps(One, Length), _mm_cmpneq_ps(Length, Zero));
+        _mm_store_ps(X + Index, _mm_mul_ps(VX, InverseLength));
+        _mm_storeu_ps(Y + Index, _mm_mul_ps(VY, InverseLength));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        hmm_vec2 Result = HMM_PREFIX(NormalizeVec2)(HMM_PREFIX(Vec2)(X[Index], Y[Index]));
+        X[Index] = Result.X;
+        Y[Index] = Result.Y;
+    }
+}
+
+COVERAGE(HMM_LengthVec2Array, 1)
+HMM_INLINE void HMM_PREFIX(LengthVec2Array)(const float *X, const float *Y, float *Out, int Count)
+{
+    ASSERT_COVERED(HMM_LengthVec2Array);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index < Count && ((size_t)(X + Index) & 15); ++Index)
+    {
+        Out[Index] = HMM_PREFIX(SquareRootF)(X[Index] * X[Index] + Y[Index] * Y[Index]);
+    }
+
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m128 VX = _mm_load_ps(X + Index);
+        __m128 VY = _mm_loadu_ps(Y + Index);
+        _mm_storeu_ps(Out + Index, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(VX, VX), _mm_mul_ps(VY, VY))));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        Out[Index] = HMM_PREFIX(SquareRootF)(X[Index] * X[Index] + Y[Index] * Y[Index]);
+    }
+}
+
+COVERAGE(HMM_LengthVec3Array, 1)
+HMM_INLINE void HMM_PREFIX(LengthVec3Array)(const float *X, const float *Y, const float *Z, float *Out, int Count)
+{
+    ASSERT_COVERED(HMM_LengthVec3Array);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index < Count && ((size_t)(X + Index) & 15); ++Index)
+    {
+        Out[Index] = HMM_PREFIX(SquareRootF)(X[Index] * X[Index] + Y[Index] * Y[Index] + Z[Index] * Z[Index]);
+    }
+
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m128 VX = _mm_load_ps(X + Index);
+        __m128 VY = _mm_loadu_ps(Y + Index);
+        __m128 VZ = _mm_loadu_ps(Z + Index);
+        __m128 LengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(VX, VX), _mm_mul_ps(VY, VY)), _mm_mul_ps(VZ, VZ));
+        _mm_storeu_ps(Out + Index, _mm_sqrt_ps(LengthSquared));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        Out[Index] = HMM_PREFIX(SquareRootF)(X[Index] * X[Index] + Y[Index] * Y[Index] + Z[Index] * Z[Index]);
+    }
+}
+
+/* X[i] += DX[i] * Scale[i], and the same for the other components */
+COVERAGE(HMM_AddScaledVec2Array, 1)
+HMM_INLINE void HMM_PREFIX(AddScaledVec2Array)(float *X, float *Y, const float *DX, const float *DY, const float *Scale, int Count)
+{
+    ASSERT_COVERED(HMM_AddScaledVec2Array);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index < Count && ((size_t)(X + Index) & 15); ++Index)
+    {
+        X[Index] += DX[Index] * Scale[Index];
+        Y[Index] += DY[Index] * Scale[Index];
+    }
+
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m128 S = _mm_loadu_ps(Scale + Index);
+        _mm_store_ps(X + Index, _mm_add_ps(_mm_load_ps(X + Index), _mm_mul_ps(_mm_loadu_ps(DX + Index), S)));
+        _mm_storeu_ps(Y + Index, _mm_add_ps(_mm_loadu_ps(Y + Index), _mm_mul_ps(_mm_loadu_ps(DY + Index), S)));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        X[Index] += DX[Index] * Scale[Index];
+        Y[Index] += DY[Index] * Scale[Index];
+    }
+}
+
+COVERAGE(HMM_AddScaledVec3Array, 1)
+HMM_INLINE void HMM_PREFIX(AddScaledVec3Array)(float *X, float *Y, float *Z, const float *DX, const float *DY, const float *DZ, const float *Scale, int Count)
+{
+    ASSERT_COVERED(HMM_AddScaledVec3Array);
+
+    int Index = 0;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    for (; Index < Count && ((size_t)(X + Index) & 15); ++Index)
+    {
+        X[Index] += DX[Index] * Scale[Index];
+        Y[Index] += DY[Index] * Scale[Index];
+        Z[Index] += DZ[Index] * Scale[Index];
+    }
+
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m128 S = _mm_loadu_ps(Scale + Index);
+        _mm_store_ps(X + Index, _mm_add_ps(_mm_load_ps(X + Index), _mm_mul_ps(_mm_loadu_ps(DX + Index), S)));
+        _mm_storeu_ps(Y + Index, _mm_add_ps(_mm_loadu_ps(Y + Index), _mm_mul_ps(_mm_loadu_ps(DY + Index), S)));
+        _mm_storeu_ps(Z + Index, _mm_add_ps(_mm_loadu_ps(Z + Index), _mm_mul_ps(_mm_loadu_ps(DZ + Index), S)));
+    }
+#endif
+
+    for (; Index < Count; ++Index)
+    {
+        X[Index] += DX[Index] * Scale[Index];
+        Y[Index] += DY[Index] * Scale[Index];
+        Z[Index] += DZ[Index] * Scale[Index];
+    }
+}
+
 /*
  * Quaternion operations
  */
@@ -3164,6 +3732,264 @@ HMM_INLINE hmm_vec4 operator-(hmm_vec4 In)
     return(Result);
 }
 
+/*
+ * Constexpr subset, for tables worked out at compile time (direction tables,
+ * spawn rings and the like). Needs C++14. Plain scalar code, and every result
+ * is built in one aggregate initialization so it stays a constant expression:
+ * hmm_vec4 members are read through XYZ and W, the members that initialization
+ * sets. At run time the regular versions above are the ones to use.
+ */
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+
+COVERAGE(HMM_ConstVec2, 1)
+HMM_INLINE constexpr hmm_vec2 HMM_PREFIX(ConstVec2)(float X, float Y)
+{
+    ASSERT_COVERED(HMM_ConstVec2);
+
+    return {{X, Y}};
+}
+
+COVERAGE(HMM_ConstVec3, 1)
+HMM_INLINE constexpr hmm_vec3 HMM_PREFIX(ConstVec3)(float X, float Y, float Z)
+{
+    ASSERT_COVERED(HMM_ConstVec3);
+
+    return {{X, Y, Z}};
+}
+
+COVERAGE(HMM_ConstVec4, 1)
+HMM_INLINE constexpr hmm_vec4 HMM_PREFIX(ConstVec4)(float X, float Y, float Z, float W)
+{
+    ASSERT_COVERED(HMM_ConstVec4);
+
+    return {{{{{X, Y, Z}}}, W}};
+}
+
+COVERAGE(HMM_ConstVec4v, 1)
+HMM_INLINE constexpr hmm_vec4 HMM_PREFIX(ConstVec4v)(hmm_vec3 Vector, float W)
+{
+    ASSERT_COVERED(HMM_ConstVec4v);
+
+    return {{{Vector}, W}};
+}
+
+COVERAGE(HMM_ConstAddVec2, 1)
+HMM_INLINE constexpr hmm_vec2 HMM_PREFIX(ConstAddVec2)(hmm_vec2 Left, hmm_vec2 Right)
+{
+    ASSERT_COVERED(HMM_ConstAddVec2);
+
+    return HMM_PREFIX(ConstVec2)(Left.X + Right.X, Left.Y + Right.Y);
+}
+
+COVERAGE(HMM_ConstAddVec3, 1)
+HMM_INLINE constexpr hmm_vec3 HMM_PREFIX(ConstAddVec3)(hmm_vec3 Left, hmm_vec3 Right)
+{
+    ASSERT_COVERED(HMM_ConstAddVec3);
+
+    return HMM_PREFIX(ConstVec3)(Left.X + Right.X, Left.Y + Right.Y, Left.Z + Right.Z);
+}
+
+COVERAGE(HMM_ConstAddVec4, 1)
+HMM_INLINE constexpr hmm_vec4 HMM_PREFIX(ConstAddVec4)(hmm_vec4 Left, hmm_vec4 Right)
+{
+    ASSERT_COVERED(HMM_ConstAddVec4);
+
+    return HMM_PREFIX(ConstVec4v)(HMM_PREFIX(ConstAddVec3)(Left.XYZ, Right.XYZ), Left.W + Right.W);
+}
+
+COVERAGE(HMM_ConstSubtractVec2, 1)
+HMM_INLINE constexpr hmm_vec2 HMM_PREFIX(ConstSubtractVec2)(hmm_vec2 Left, hmm_vec2 Right)
+{
+    ASSERT_COVERED(HMM_ConstSubtractVec2);
+
+    return HMM_PREFIX(ConstVec2)(Left.X - Right.X, Left.Y - Right.Y);
+}
+
+COVERAGE(HMM_ConstSubtractVec3, 1)
+HMM_INLINE constexpr hmm_vec3 HMM_PREFIX(ConstSubtractVec3)(hmm_vec3 Left, hmm_vec3 Right)
+{
+    ASSERT_COVERED(HMM_ConstSubtractVec3);
+
+    return HMM_PREFIX(ConstVec3)(Left.X - Right.X, Left.Y - Right.Y, Left.Z - Right.Z);
+}
+
+COVERAGE(HMM_ConstSubtractVec4, 1)
+HMM_INLINE constexpr hmm_vec4 HMM_PREFIX(ConstSubtractVec4)(hmm_vec4 Left, hmm_vec4 Right)
+{
+    ASSERT_COVERED(HMM_ConstSubtractVec4);
+
+    return HMM_PREFIX(ConstVec4v)(HMM_PREFIX(ConstSubtractVec3)(Left.XYZ, Right.XYZ), Left.W - Right.W);
+}
+
+COVERAGE(HMM_ConstMultiplyVec2f, 1)
+HMM_INLINE constexpr hmm_vec2 HMM_PREFIX(ConstMultiplyVec2f)(hmm_vec2 Left, float Right)
+{
+    ASSERT_COVERED(HMM_ConstMultiplyVec2f);
+
+    return HMM_PREFIX(ConstVec2)(Left.X * Right, Left.Y * Right);
+}
+
+COVERAGE(HMM_ConstMultiplyVec3f, 1)
+HMM_INLINE constexpr hmm_vec3 HMM_PREFIX(ConstMultiplyVec3f)(hmm_vec3 Left, float Right)
+{
+    ASSERT_COVERED(HMM_ConstMultiplyVec3f);
+
+    return HMM_PREFIX(ConstVec3)(Left.X * Right, Left.Y * Right, Left.Z * Right);
+}
+
+COVERAGE(HMM_ConstMultiplyVec4f, 1)
+HMM_INLINE constexpr hmm_vec4 HMM_PREFIX(ConstMultiplyVec4f)(hmm_vec4 Left, float Right)
+{
+    ASSERT_COVERED(HMM_ConstMultiplyVec4f);
+
+    return HMM_PREFIX(ConstVec4v)(HMM_PREFIX(ConstMultiplyVec3f)(Left.XYZ, Right), Left.W * Right);
+}
+
+COVERAGE(HMM_ConstDotVec2, 1)
+HMM_INLINE constexpr float HMM_PREFIX(ConstDotVec2)(hmm_vec2 VecOne, hmm_vec2 VecTwo)
+{
+    ASSERT_COVERED(HMM_ConstDotVec2);
+
+    return (VecOne.X * VecTwo.X) + (VecOne.Y * VecTwo.Y);
+}
+
+COVERAGE(HMM_ConstDotVec3, 1)
+HMM_INLINE constexpr float HMM_PREFIX(ConstDotVec3)(hmm_vec3 VecOne, hmm_vec3 VecTwo)
+{
+    ASSERT_COVERED(HMM_ConstDotVec3);
+
+    return (VecOne.X * VecTwo.X) + (VecOne.Y * VecTwo.Y) + (VecOne.Z * VecTwo.Z);
+}
+
+COVERAGE(HMM_ConstDotVec4, 1)
+HMM_INLINE constexpr float HMM_PREFIX(ConstDotVec4)(hmm_vec4 VecOne, hmm_vec4 VecTwo)
+{
+    ASSERT_COVERED(HMM_ConstDotVec4);
+
+    return (VecOne.XYZ.X * VecTwo.XYZ.X) + (VecOne.XYZ.Y * VecTwo.XYZ.Y) + (VecOne.XYZ.Z * VecTwo.XYZ.Z) + (VecOne.W * VecTwo.W);
+}
+
+COVERAGE(HMM_ConstCross, 1)
+HMM_INLINE constexpr hmm_vec3 HMM_PREFIX(ConstCross)(hmm_vec3 VecOne, hmm_vec3 VecTwo)
+{
+    ASSERT_COVERED(HMM_ConstCross);
+
+    return HMM_PREFIX(ConstVec3)((VecOne.Y * VecTwo.Z) - (VecOne.Z * VecTwo.Y),
+                                 (VecOne.Z * VecTwo.X) - (VecOne.X * VecTwo.Z),
+                                 (VecOne.X * VecTwo.Y) - (VecOne.Y * VecTwo.X));
+}
+
+COVERAGE(HMM_ConstMat4, 1)
+HMM_INLINE constexpr hmm_mat4 HMM_PREFIX(ConstMat4)(void)
+{
+    ASSERT_COVERED(HMM_ConstMat4);
+
+    return {{{0.0f, 0.0f, 0.0f, 0.0f},
+             {0.0f, 0.0f, 0.0f, 0.0f},
+             {0.0f, 0.0f, 0.0f, 0.0f},
+             {0.0f, 0.0f, 0.0f, 0.0f}}};
+}
+
+COVERAGE(HMM_ConstMat4d, 1)
+HMM_INLINE constexpr hmm_mat4 HMM_PREFIX(ConstMat4d)(float Diagonal)
+{
+    ASSERT_COVERED(HMM_ConstMat4d);
+
+    return {{{Diagonal, 0.0f, 0.0f, 0.0f},
+             {0.0f, Diagonal, 0.0f, 0.0f},
+             {0.0f, 0.0f, Diagonal, 0.0f},
+             {0.0f, 0.0f, 0.0f, Diagonal}}};
+}
+
+COVERAGE(HMM_ConstTranslate, 1)
+HMM_INLINE constexpr hmm_mat4 HMM_PREFIX(ConstTranslate)(hmm_vec3 Translation)
+{
+    ASSERT_COVERED(HMM_ConstTranslate);
+
+    return {{{1.0f, 0.0f, 0.0f, 0.0f},
+             {0.0f, 1.0f, 0.0f, 0.0f},
+             {0.0f, 0.0f, 1.0f, 0.0f},
+             {Translation.X, Translation.Y, Translation.Z, 1.0f}}};
+}
+
+COVERAGE(HMM_ConstScale, 1)
+HMM_INLINE constexpr hmm_mat4 HMM_PREFIX(ConstScale)(hmm_vec3 Scale)
+{
+    ASSERT_COVERED(HMM_ConstScale);
+
+    return {{{Scale.X, 0.0f, 0.0f, 0.0f},
+             {0.0f, Scale.Y, 0.0f, 0.0f},
+             {0.0f, 0.0f, Scale.Z, 0.0f},
+             {0.0f, 0.0f, 0.0f, 1.0f}}};
+}
+
+COVERAGE(HMM_ConstMultiplyMat4, 1)
+HMM_INLINE constexpr hmm_mat4 HMM_PREFIX(ConstMultiplyMat4)(hmm_mat4 Left, hmm_mat4 Right)
+{
+    ASSERT_COVERED(HMM_ConstMultiplyMat4);
+
+    hmm_mat4 Result = HMM_PREFIX(ConstMat4)();
+
+    for(int Columns = 0; Columns < 4; ++Columns)
+    {
+        for(int Rows = 0; Rows < 4; ++Rows)
+        {
+            float Sum = 0;
+            for(int CurrentMatrice = 0; CurrentMatrice < 4; ++CurrentMatrice)
+            {
+                Sum += Left.Elements[CurrentMatrice][Rows] * Right.Elements[Columns][CurrentMatrice];
+            }
+
+            Result.Elements[Columns][Rows] = Sum;
+        }
+    }
+
+    return (Result);
+}
+
+/*
+ * The same steps as SinCosApproxF, so a baked table matches what it computes
+ * at run time. Returns (sin, cos).
+ */
+COVERAGE(HMM_ConstSinCosF, 1)
+HMM_INLINE constexpr hmm_vec2 HMM_PREFIX(ConstSinCosF)(float Radians)
+{
+    ASSERT_COVERED(HMM_ConstSinCosF);
+
+    float Scaled = Radians * HMM_APPROX_TWO_OVER_PI;
+    int Quadrant = (int)(Scaled + (Scaled < 0.0f ? -0.5f : 0.5f));
+    float J = (float)Quadrant;
+    float R = ((Radians - J * HMM_APPROX_PI_OVER_2_A) - J * HMM_APPROX_PI_OVER_2_B) - J * HMM_APPROX_PI_OVER_2_C;
+    float R2 = R * R;
+
+    float S = R + R * R2 * (HMM_APPROX_SIN_1 + R2 * (HMM_APPROX_SIN_2 + R2 * HMM_APPROX_SIN_3));
+    float C = (1.0f - 0.5f * R2) + R2 * R2 * (HMM_APPROX_COS_1 + R2 * (HMM_APPROX_COS_2 + R2 * HMM_APPROX_COS_3));
+
+    float SinResult = (Quadrant & 1) ? C : S;
+    float CosResult = (Quadrant & 1) ? S : C;
+    return HMM_PREFIX(ConstVec2)((Quadrant & 2) ? -SinResult : SinResult,
+                                 ((Quadrant + 1) & 2) ? -CosResult : CosResult);
+}
+
+COVERAGE(HMM_ConstSinF, 1)
+HMM_INLINE constexpr float HMM_PREFIX(ConstSinF)(float Radians)
+{
+    ASSERT_COVERED(HMM_ConstSinF);
+
+    return HMM_PREFIX(ConstSinCosF)(Radians).X;
+}
+
+COVERAGE(HMM_ConstCosF, 1)
+HMM_INLINE constexpr float HMM_PREFIX(ConstCosF)(float Radians)
+{
+    ASSERT_COVERED(HMM_ConstCosF);
+
+    return HMM_PREFIX(ConstSinCosF)(Radians).Y;
+}
+
+#endif /* C++14 */
+
 #endif /* __cplusplus */
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+
+// Replaces the global operator new/delete to count every allocation, per
+// thread, so a scope can tell what it allocated. Include from exactly one
+// translation unit.
+//
+// The game is meant to allocate nothing once it's running. While
+// ForbidAllocations() is in effect, an operator new on any thread reports and
+// aborts, which is what --assert-no-alloc runs use to catch regressions.
+
+struct AllocationCount {
+    i64 count;
+    i64 bytes;
+};
+
+static thread_local AllocationCount thread_allocations;
+static std::atomic<i32> allocations_forbidden {0};
+
+inline void ForbidAllocations() { allocations_forbidden.fetch_add(1, std::memory_order_relaxed); }
+inline void AllowAllocations()  { allocations_forbidden.fetch_sub(1, std::memory_order_relaxed); }
+
+// What this thread allocated between begin() and end()
+struct AllocationScope {
+    AllocationCount start;
+
+    void begin() {
+        start = thread_allocations;
+    }
+
+    AllocationCount end() {
+        return { thread_allocations.count - start.count, thread_allocations.bytes - start.bytes };
+    }
+};
+
+static void *TrackedAllocate(size_t size, size_t alignment) {
+    if (allocations_forbidden.load(std::memory_order_relaxed) > 0) {
+        // stdio allocates through malloc, not operator new, so this can't recurse
+        fprintf(stderr, "heap allocation of %zu bytes after warm-up, allocations are forbidden here\n", size);
+        abort();
+    }
+
+    thread_allocations.count++;
+    thread_allocations.bytes += size;
+
+    if (size == 0) size = 1;
+    void *memory;
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        memory = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    } else {
+        memory = malloc(size);
+    }
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new(size_t size)                               { return TrackedAllocate(size, 0); }
+void *operator new[](size_t size)                             { return TrackedAllocate(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment)   { return TrackedAllocate(size, (size_t)alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return TrackedAllocate(size, (size_t)alignment); }
+
+void operator delete(void *memory) noexcept                             { free(memory); }
+void operator delete[](void *memory) noexcept                           { free(memory); }
+void operator delete(void *memory, size_t) noexcept                     { free(memory); }
+void operator delete[](void *memory, size_t) noexcept                   { free(memory); }
+void operator delete(void *memory, std::align_val_t) noexcept           { free(memory); }
+void operator delete[](void *memory, std::align_val_t) noexcept         { free(memory); }
+void operator delete(void *memory, size_t, std::align_val_t) noexcept   { free(memory); }
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept { free(memory); }
@@ -0,0 +1,108 @@
+// Throughput of the hot HandMadeMath functions with and without its SSE
+// paths, in one run. The scalar half is its own translation unit, built with
+// HANDMADE_MATH_NO_SSE:
+//
+//   g++ -O2 bench/hmm_bench.cpp bench/hmm_bench_scalar.cpp -o hmm_bench
+//
+// Prints ns per op for both and the SSE speedup, or JSON with --json.
+// --accuracy instead prints the largest errors of the polynomial sin/cos,
+// atan2 and exp against libm, in both modes, and exits 1 if one is past the
+// bound HandMadeMath.h documents for it. --check compares the batched
+// kernels' outputs to the scalar HMM functions they replace, and the
+// constexpr Const functions to the run time ones they repeat, in both modes,
+// and exits 1 if any is off by more than its tolerance.
+
+#include <stdio.h>
+#include <string.h>
+
+#define HMM_BENCH_ENTRY RunHMMBenchSSE
+#define HMM_ACCURACY_ENTRY RunHMMAccuracySSE
+#define HMM_CHECK_ENTRY RunHMMCheckSSE
+#include "hmm_bench.h"
+
+i32 RunHMMBenchScalar(HMMBenchResult *results, i32 max_results);
+i32 RunHMMAccuracyScalar(HMMAccuracyResult *results, i32 max_results);
+i32 RunHMMCheckScalar(HMMCheckResult *results, i32 max_results);
+
+// False if an error was past its documented bound in either mode
+static bool PrintAccuracy() {
+    HMMAccuracyResult sse[HMM_ACCURACY_MAX_RESULTS];
+    HMMAccuracyResult scalar[HMM_ACCURACY_MAX_RESULTS];
+    i32 count = RunHMMAccuracySSE(sse, HMM_ACCURACY_MAX_RESULTS);
+    count = HMM_MIN(count, RunHMMAccuracyScalar(scalar, HMM_ACCURACY_MAX_RESULTS));
+
+    bool passed = true;
+    printf("%-20s %22s %22s %9s\n", "max error", "sse (at)", "scalar (at)", "bound");
+    for (i32 i = 0; i < count; i++) {
+        bool within = sse[i].max_error <= sse[i].bound && scalar[i].max_error <= scalar[i].bound;
+        printf("%-20s %9.3g %-3s (%8.4g) %9.3g %-3s (%8.4g) %9.3g%s\n", sse[i].name,
+            sse[i].max_error, sse[i].relative ? "rel" : "abs", sse[i].worst_input,
+            scalar[i].max_error, scalar[i].relative ? "rel" : "abs", scalar[i].worst_input,
+            sse[i].bound, within ? "" : "  EXCEEDED");
+        if (!within) passed = false;
+    }
+    return passed;
+}
+
+// False if a kernel was off in either mode
+static bool PrintCheck() {
+    HMMCheckResult sse[HMM_CHECK_MAX_RESULTS];
+    HMMCheckResult scalar[HMM_CHECK_MAX_RESULTS];
+    i32 count = RunHMMCheckSSE(sse, HMM_CHECK_MAX_RESULTS);
+    count = HMM_MIN(count, RunHMMCheckScalar(scalar, HMM_CHECK_MAX_RESULTS));
+
+    bool passed = true;
+    printf("%-20s %26s %26s\n", "check", "sse (max error)", "scalar (max error)");
+    for (i32 i = 0; i < count; i++) {
+        printf("%-20s %5d of %5d off (%9.3g) %5d of %5d off (%9.3g), tolerance %g\n", sse[i].name,
+            sse[i].failed, sse[i].checked, sse[i].max_error, scalar[i].failed, scalar[i].checked, scalar[i].max_error, sse[i].tolerance);
+        if (sse[i].failed || scalar[i].failed) passed = false;
+    }
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    bool json = argc > 1 && strcmp(argv[1], "--json") == 0;
+    if (argc > 1 && strcmp(argv[1], "--accuracy") == 0) {
+        return PrintAccuracy() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        return PrintCheck() ? 0 : 1;
+    }
+
+    HMMBenchResult sse[HMM_BENCH_MAX_RESULTS];
+    HMMBenchResult scalar[HMM_BENCH_MAX_RESULTS];
+    i32 count = RunHMMBenchSSE(sse, HMM_BENCH_MAX_RESULTS);
+    i32 scalar_count = RunHMMBenchScalar(scalar, HMM_BENCH_MAX_RESULTS);
+    count = HMM_MIN(count, scalar_count);
+
+#ifdef HANDMADE_MATH__USE_SSE
+    const char *mode = "sse";
+#else
+    const char *mode = "scalar (no SSE on this target)";
+#endif
+
+    if (json) {
+        printf("{\n  \"mode\": \"%s\",\n  \"ops\": {\n", mode);
+    } else {
+        printf("%-20s %12s %12s %8s\n", "op", mode, "scalar", "speedup");
+    }
+
+    for (i32 i = 0; i < count; i++) {
+        // Both modes ran the same inputs, so a differing checksum is a math difference
+        f32 difference = fabsf(sse[i].checksum - scalar[i].checksum);
+        bool matches = difference <= 1e-3f * HMM_MAX(1.0f, fabsf(scalar[i].checksum));
+        f64 speedup = sse[i].ns_per_op > 0 ? scalar[i].ns_per_op / sse[i].ns_per_op : 0.0;
+
+        if (json) {
+            printf("    \"%s\": {\"sse_ns\": %.3f, \"scalar_ns\": %.3f, \"speedup\": %.3f, \"results_match\": %s}%s\n",
+                sse[i].name, sse[i].ns_per_op, scalar[i].ns_per_op, speedup, matches ? "true" : "false", i + 1 < count ? "," : "");
+        } else {
+            printf("%-20s %9.2f ns %9.2f ns %7.2fx%s\n", sse[i].name, sse[i].ns_per_op, scalar[i].ns_per_op, speedup,
+                matches ? "" : "  (results differ)");
+        }
+    }
+
+    if (json) printf("  }\n}\n");
+    return 0;
+}
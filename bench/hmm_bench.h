@@ -0,0 +1,362 @@
+// HandMadeMath microbenchmark kernels. Included once per math mode, by
+// hmm_bench.cpp (SSE where available) and hmm_bench_scalar.cpp
+// (HANDMADE_MATH_NO_SSE, inside its own namespace), each defining
+// HMM_BENCH_ENTRY, HMM_ACCURACY_ENTRY and HMM_CHECK_ENTRY first. Only the result types of
+// hmm_bench_results.h cross between the translation units.
+//
+// No #pragma once on purpose.
+
+#include <chrono>
+#include <math.h>
+
+#include "../HandMadeMath.h"
+#include "../defines.h"
+#include "../heading.h"
+#include "hmm_bench_results.h"
+
+#if !defined(HMM_BENCH_ENTRY) || !defined(HMM_ACCURACY_ENTRY) || !defined(HMM_CHECK_ENTRY)
+#error "define HMM_BENCH_ENTRY, HMM_ACCURACY_ENTRY and HMM_CHECK_ENTRY before including hmm_bench.h"
+#endif
+
+namespace {
+
+constexpr i32 bench_count {1024};   // inputs per pass, small enough to stay in L1/L2
+constexpr i32 bench_passes {200};   // per timed repeat
+constexpr i32 bench_repeats {7};
+
+struct BenchData {
+    hmm_vec3 a3[bench_count], b3[bench_count];
+    hmm_vec4 a4[bench_count];
+    hmm_mat4 m[bench_count / 16];
+    hmm_quaternion qa[bench_count], qb[bench_count];
+    f32 f[bench_count];
+
+    hmm_vec3 out3[bench_count];
+    hmm_vec4 out4[bench_count];
+    hmm_mat4 outm[bench_count];
+    hmm_quaternion outq[bench_count];
+    f32 outf[bench_count];
+    alignas(16) f32 soa_x[bench_count], soa_y[bench_count]; // written by the array kernels
+    f32 angle[bench_count];  // radians, a few turns either way
+    f32 outf2[bench_count];
+};
+
+// Same sequence in both modes, so the checksums can be compared
+f32 BenchRandom(u32 *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return ((*state >> 8) / 16777216.0f) * 2.0f - 1.0f;
+}
+
+void FillBenchData(BenchData *data) {
+    u32 state = 12345;
+    for (i32 i = 0; i < bench_count; i++) {
+        data->a3[i] = HMM_Vec3(BenchRandom(&state), BenchRandom(&state), BenchRandom(&state) + 2.0f);
+        data->b3[i] = HMM_Vec3(BenchRandom(&state), BenchRandom(&state), BenchRandom(&state));
+        data->a4[i] = HMM_Vec4(BenchRandom(&state), BenchRandom(&state), BenchRandom(&state), 1.0f);
+        data->qa[i] = HMM_NormalizeQuaternion(HMM_Quaternion(BenchRandom(&state), BenchRandom(&state), BenchRandom(&state), 1.0f));
+        data->qb[i] = HMM_NormalizeQuaternion(HMM_Quaternion(BenchRandom(&state), BenchRandom(&state), BenchRandom(&state), 1.0f));
+        data->f[i] = BenchRandom(&state) + 2.0f; // positive, for the square roots
+        data->soa_x[i] = BenchRandom(&state);
+        data->soa_y[i] = BenchRandom(&state);
+        data->angle[i] = BenchRandom(&state) * 20.0f;
+    }
+    for (i32 i = 0; i < bench_count / 16; i++) {
+        for (i32 c = 0; c < 4; c++) {
+            for (i32 r = 0; r < 4; r++) {
+                data->m[i].Elements[c][r] = BenchRandom(&state);
+            }
+        }
+    }
+}
+
+// Stops the compiler from merging or dropping passes whose stores get overwritten
+inline void BenchBarrier() {
+    asm volatile("" ::: "memory");
+}
+
+} // namespace
+
+// Times `body` over i in [0, bench_count) bench_passes times, best of
+// bench_repeats, and stores ns per element
+#define HMM_BENCH_OP(label, body, checksum_expression)                                          \
+    {                                                                                           \
+        f64 best = 1e30;                                                                        \
+        for (i32 repeat = 0; repeat < bench_repeats; repeat++) {                                \
+            auto start = std::chrono::steady_clock::now();                                      \
+            for (i32 pass = 0; pass < bench_passes; pass++) {                                   \
+                for (i32 i = 0; i < bench_count; i++) {                                         \
+                    body;                                                                       \
+                }                                                                               \
+                BenchBarrier();                                                                 \
+            }                                                                                   \
+            std::chrono::duration<f64, std::nano> elapsed = std::chrono::steady_clock::now() - start; \
+            best = HMM_MIN(best, elapsed.count() / ((f64)bench_passes * bench_count));         \
+        }                                                                                       \
+        f32 checksum = 0;                                                                       \
+        for (i32 i = 0; i < bench_count; i++) {                                                 \
+            checksum += checksum_expression;                                                    \
+        }                                                                                       \
+        if (count < max_results) results[count++] = { label, best, checksum };                  \
+    }
+
+i32 HMM_BENCH_ENTRY(HMMBenchResult *results, i32 max_results) {
+    static BenchData data;
+    FillBenchData(&data);
+    BenchData *d = &data;
+    i32 count = 0;
+
+    HMM_BENCH_OP("SquareRootF",
+        d->outf[i] = HMM_SquareRootF(d->f[i]),
+        d->outf[i]);
+
+    HMM_BENCH_OP("RSquareRootF",
+        d->outf[i] = HMM_RSquareRootF(d->f[i]),
+        d->outf[i]);
+
+    HMM_BENCH_OP("DotVec3",
+        d->outf[i] = HMM_DotVec3(d->a3[i], d->b3[i]),
+        d->outf[i]);
+
+    HMM_BENCH_OP("NormalizeVec3",
+        d->out3[i] = HMM_NormalizeVec3(d->a3[i]),
+        d->out3[i].X + d->out3[i].Y + d->out3[i].Z);
+
+    HMM_BENCH_OP("NormalizeVec4",
+        d->out4[i] = HMM_NormalizeVec4(d->a4[i]),
+        d->out4[i].X + d->out4[i].W);
+
+    HMM_BENCH_OP("MultiplyMat4",
+        d->outm[i] = HMM_MultiplyMat4(d->m[i & 63], d->m[(i + 1) & 63]),
+        d->outm[i].Elements[0][0] + d->outm[i].Elements[3][3]);
+
+    HMM_BENCH_OP("MultiplyMat4ByVec4",
+        d->out4[i] = HMM_MultiplyMat4ByVec4(d->m[i & 63], d->a4[i]),
+        d->out4[i].X + d->out4[i].W);
+
+    HMM_BENCH_OP("Slerp",
+        d->outq[i] = HMM_Slerp(d->qa[i], 0.3f, d->qb[i]),
+        d->outq[i].X + d->outq[i].W);
+
+    HMM_BENCH_OP("LookAt",
+        d->outm[i] = HMM_LookAt(d->a3[i], d->b3[i], HMM_Vec3(0, 1, 0)),
+        d->outm[i].Elements[3][0] + d->outm[i].Elements[0][0]);
+
+    HMM_BENCH_OP("Perspective",
+        d->outm[i] = HMM_Perspective(40.0f + d->f[i], 1.5f, 0.1f, 1000.0f),
+        d->outm[i].Elements[0][0] + d->outm[i].Elements[2][2]);
+
+    // Batched, so the whole array is one call; still reported per instance
+    HMM_BENCH_OP("InstanceTransforms",
+        if (i == 0) HMM_InstanceTransforms(d->f, d->f, d->f, d->f, d->f, d->f, d->f, bench_count, d->outm),
+        d->outm[i].Elements[3][0] + d->outm[i].Elements[0][0]);
+
+    HMM_BENCH_OP("NormalizeVec2Array",
+        if (i == 0) HMM_NormalizeVec2Array(d->soa_x, d->soa_y, bench_count),
+        d->soa_x[i] + d->soa_y[i]);
+
+    HMM_BENCH_OP("LengthVec3Array",
+        if (i == 0) HMM_LengthVec3Array(d->f, d->soa_x, d->soa_y, d->outf, bench_count),
+        d->outf[i]);
+
+    HMM_BENCH_OP("sinf+cosf (libm)",
+        { d->outf[i] = sinf(d->angle[i]); d->outf2[i] = cosf(d->angle[i]); },
+        d->outf[i] + d->outf2[i]);
+
+    HMM_BENCH_OP("SinCosFArray",
+        if (i == 0) HMM_SinCosFArray(d->angle, d->outf, d->outf2, bench_count),
+        d->outf[i] + d->outf2[i]);
+
+    HMM_BENCH_OP("atan2f (libm)",
+        d->outf[i] = atan2f(d->soa_y[i], d->soa_x[i]),
+        d->outf[i]);
+
+    HMM_BENCH_OP("ATan2FArray",
+        if (i == 0) HMM_ATan2FArray(d->soa_y, d->soa_x, d->outf, bench_count),
+        d->outf[i]);
+
+    HMM_BENCH_OP("expf (libm)",
+        d->outf[i] = expf(d->angle[i]),
+        d->outf[i] * 1e-6f);
+
+    HMM_BENCH_OP("ExpFArray",
+        if (i == 0) HMM_ExpFArray(d->angle, d->outf, bench_count),
+        d->outf[i] * 1e-6f);
+
+    return count;
+}
+
+// Sweeps the polynomial approximations over their documented ranges,
+// endpoints included. The bounds are the ones HandMadeMath.h documents.
+i32 HMM_ACCURACY_ENTRY(HMMAccuracyResult *results, i32 max_results) {
+    constexpr i32 batch {4096};
+    static f32 in_x[batch], in_y[batch], out_a[batch], out_b[batch];
+    HMMAccuracyResult sin = { "sin, |x| <= 8192", 0, 0, false, 1e-7 };
+    HMMAccuracyResult cos = { "cos, |x| <= 8192", 0, 0, false, 1e-7 };
+    HMMAccuracyResult atan2 = { "atan2", 0, 0, false, 3e-7 };
+    HMMAccuracyResult exp = { "exp, -87.3..88.3", 0, 0, true, 1e-7 };
+
+    // Every float in [-2pi, 2pi] would take a while: steps of about 1e-6
+    // there, coarser out to 8192. steps + 1 points, so both ends are in.
+    for (i32 range = 0; range < 2; range++) {
+        f64 limit = range ? 8192.0 : 2.0 * HMM_PI;
+        i32 steps = range ? 1 << 22 : 1 << 24;
+        for (i32 start = 0; start <= steps; start += batch) {
+            i32 n = HMM_MIN(batch, steps + 1 - start);
+            for (i32 b = 0; b < n; b++) {
+                in_x[b] = (f32)(-limit + 2.0 * limit * (start + b) / steps);
+            }
+            HMM_SinCosFArray(in_x, out_a, out_b, n);
+            for (i32 b = 0; b < n; b++) {
+                f64 sin_error = fabs(out_a[b] - ::sin((f64)in_x[b]));
+                f64 cos_error = fabs(out_b[b] - ::cos((f64)in_x[b]));
+                if (sin_error > sin.max_error) sin = { sin.name, sin_error, in_x[b], false, sin.bound };
+                if (cos_error > cos.max_error) cos = { cos.name, cos_error, in_x[b], false, cos.bound };
+            }
+        }
+    }
+
+    // All directions, at radii from tiny to huge, and the axes and zeros
+    i32 steps = 1 << 22;
+    for (i32 start = 0; start <= steps; start += batch) {
+        i32 size = HMM_MIN(batch, steps + 1 - start);
+        for (i32 b = 0; b < size; b++) {
+            i32 n = start + b;
+            f64 angle = 2.0 * HMM_PI * n / steps - HMM_PI;
+            f64 radius = ::pow(10.0, (n % 13) - 6);
+            in_y[b] = (f32)(radius * ::sin(angle));
+            in_x[b] = (f32)(radius * ::cos(angle));
+            if (n % 1009 == 0) in_x[b] = 0;
+            if (n % 1013 == 0) in_y[b] = 0;
+            if (n % 1019 == 0) in_x[b] = -0.0f;
+        }
+        HMM_ATan2FArray(in_y, in_x, out_a, size);
+        for (i32 b = 0; b < size; b++) {
+            f64 error = fabs(out_a[b] - ::atan2((f64)in_y[b], (f64)in_x[b]));
+            if (error > atan2.max_error) atan2 = { atan2.name, error, ::atan2((f64)in_y[b], (f64)in_x[b]), false, atan2.bound };
+        }
+    }
+
+    steps = 1 << 22;
+    for (i32 start = 0; start <= steps; start += batch) {
+        i32 size = HMM_MIN(batch, steps + 1 - start);
+        for (i32 b = 0; b < size; b++) {
+            in_x[b] = (f32)(HMM_APPROX_EXP_MIN + ((f64)HMM_APPROX_EXP_MAX - HMM_APPROX_EXP_MIN) * (start + b) / steps);
+        }
+        HMM_ExpFArray(in_x, out_a, size);
+        for (i32 b = 0; b < size; b++) {
+            f64 exact = ::exp((f64)in_x[b]);
+            f64 error = fabs(out_a[b] - exact) / exact;
+            if (error > exp.max_error) exp = { exp.name, error, in_x[b], true, exp.bound };
+        }
+    }
+
+    i32 count = 0;
+    HMMAccuracyResult all[] = { sin, cos, atan2, exp };
+    for (HMMAccuracyResult result : all) {
+        if (count < max_results) results[count++] = result;
+    }
+    return count;
+}
+
+// Compares the batched kernels, every output, to the scalar HMM functions
+// they replace. Counts that aren't multiples of 4 run the SSE tails too.
+i32 HMM_CHECK_ENTRY(HMMCheckResult *results, i32 max_results) {
+    constexpr i32 max_count {1031};
+    static f32 x[max_count + 1], y[max_count + 1], z[max_count + 1];
+    static f32 scale_x[max_count + 1], scale_y[max_count + 1], scale_z[max_count + 1], yaw[max_count + 1];
+    static hmm_mat4 out[max_count];
+
+    u32 state = 777;
+    for (i32 i = 0; i < max_count + 1; i++) {
+        x[i] = BenchRandom(&state) * 100.0f;
+        y[i] = BenchRandom(&state) * 10.0f;
+        z[i] = BenchRandom(&state) * 100.0f;
+        scale_x[i] = 1.5f + BenchRandom(&state) * 1.4f;
+        scale_y[i] = 1.5f + BenchRandom(&state) * 1.4f;
+        scale_z[i] = 1.5f + BenchRandom(&state) * 1.4f;
+        yaw[i] = BenchRandom(&state) * 720.0f; // degrees, two turns either way
+    }
+    yaw[0] = 0;
+    yaw[1] = 90.0f;
+    yaw[2] = -180.0f;
+
+    // Translate(p) * Rotate(yaw, y) * Scale(s)
+    HMMCheckResult transforms = { "InstanceTransforms", 0, 0, 0, 1e-5 };
+    static const i32 counts[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 15, 16, 17, 63, 64, 65, 1000, max_count };
+    for (i32 count : counts) {
+        // An odd start as well, so the inputs aren't all 16 byte aligned
+        for (i32 offset = 0; offset < 2; offset++) {
+            HMM_InstanceTransforms(x + offset, y + offset, z + offset, scale_x + offset, scale_y + offset, scale_z + offset,
+                                   yaw + offset, count, out);
+            for (i32 i = 0; i < count; i++) {
+                i32 n = i + offset;
+                hmm_mat4 expected = HMM_MultiplyMat4(HMM_Translate(HMM_Vec3(x[n], y[n], z[n])),
+                    HMM_MultiplyMat4(HMM_Rotate(yaw[n], HMM_Vec3(0, 1, 0)), HMM_Scale(HMM_Vec3(scale_x[n], scale_y[n], scale_z[n]))));
+
+                bool failed = false;
+                for (i32 c = 0; c < 4; c++) {
+                    for (i32 r = 0; r < 4; r++) {
+                        f64 want = expected.Elements[c][r];
+                        f64 error = fabs(out[i].Elements[c][r] - want) / HMM_MAX(1.0, fabs(want));
+                        transforms.max_error = HMM_MAX(transforms.max_error, error);
+                        if (!(error <= transforms.tolerance)) failed = true;
+                    }
+                }
+                transforms.checked++;
+                if (failed) transforms.failed++;
+            }
+        }
+    }
+
+    // The constexpr copies against the run time functions they repeat. Tables
+    // baked with them are only right if the two agree to the bit.
+    HMMCheckResult sin_cos = { "ConstSinCosF", 0, 0, 0, 0 };
+    for (i32 i = 0; i <= 40000; i++) {
+        f32 radians = (i - 20000) * (4.0f * HMM_PI32 / 20000.0f); // two turns either way
+        f32 sine, cosine;
+        HMM_SinCosApproxF(radians, &sine, &cosine);
+        hmm_vec2 baked = HMM_ConstSinCosF(radians);
+        f64 error = HMM_MAX(fabs((f64)baked.X - sine), fabs((f64)baked.Y - cosine));
+        sin_cos.max_error = HMM_MAX(sin_cos.max_error, error);
+        sin_cos.checked++;
+        if (!(error <= sin_cos.tolerance)) sin_cos.failed++;
+    }
+    // heading_table, which the compiler worked out
+    for (i32 k = 0; k < HEADING_COUNT; k++) {
+        f32 sine, cosine;
+        HMM_SinCosApproxF(k * heading_radians, &sine, &cosine);
+        f64 error = HMM_MAX(fabs((f64)heading_table.x[k] - cosine), fabs((f64)heading_table.z[k] - sine));
+        sin_cos.max_error = HMM_MAX(sin_cos.max_error, error);
+        sin_cos.checked++;
+        if (!(error <= sin_cos.tolerance)) sin_cos.failed++;
+    }
+
+    HMMCheckResult multiply = { "ConstMultiplyMat4", 0, 0, 0, 0 };
+    for (i32 i = 0; i < 1000; i++) {
+        hmm_mat4 left, right;
+        for (i32 c = 0; c < 4; c++) {
+            for (i32 r = 0; r < 4; r++) {
+                left.Elements[c][r] = BenchRandom(&state) * 10.0f;
+                right.Elements[c][r] = BenchRandom(&state) * 10.0f;
+            }
+        }
+        hmm_mat4 expected = HMM_MultiplyMat4(left, right);
+        hmm_mat4 baked = HMM_ConstMultiplyMat4(left, right);
+        bool failed = false;
+        for (i32 c = 0; c < 4; c++) {
+            for (i32 r = 0; r < 4; r++) {
+                f64 error = fabs((f64)baked.Elements[c][r] - expected.Elements[c][r]);
+                multiply.max_error = HMM_MAX(multiply.max_error, error);
+                if (!(error <= multiply.tolerance)) failed = true;
+            }
+        }
+        multiply.checked++;
+        if (failed) multiply.failed++;
+    }
+
+    i32 count = 0;
+    if (count < max_results) results[count++] = transforms;
+    if (count < max_results) results[count++] = sin_cos;
+    if (count < max_results) results[count++] = multiply;
+    return count;
+}
@@ -0,0 +1,38 @@
+// What the hmm_bench kernels report, shared by both modes. Only these plain
+// types cross between its translation units.
+
+#pragma once
+
+#include "../defines.h"
+
+struct HMMBenchResult {
+    const char *name;
+    f64 ns_per_op; // best of the repeats
+    f32 checksum;  // keeps the results alive, and should match between modes
+};
+
+#define HMM_BENCH_MAX_RESULTS 24
+
+// Largest error over a sweep, against double precision libm. worst_input is
+// where it happened (the angle, for atan2). bound is the error documented for
+// the function in HandMadeMath.h.
+struct HMMAccuracyResult {
+    const char *name;
+    f64 max_error;
+    f64 worst_input;
+    bool relative;
+    f64 bound;
+};
+
+#define HMM_ACCURACY_MAX_RESULTS 8
+
+// A kernel compared against the plain HMM functions it stands for
+struct HMMCheckResult {
+    const char *name;
+    i32 checked;    // outputs compared
+    i32 failed;     // of those, off by more than tolerance
+    f64 max_error;
+    f64 tolerance;  // absolute, relative for values past 1
+};
+
+#define HMM_CHECK_MAX_RESULTS 8
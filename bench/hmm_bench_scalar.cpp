@@ -0,0 +1,30 @@
+// The scalar half of hmm_bench, see hmm_bench.cpp. Without SSE the HMM
+// unions lose their __m128 members, so these are different types from the
+// SSE half's under the same names; they live in a namespace of their own to
+// keep the two definitions apart. Everything the kernels include gets
+// included out here first, where it belongs.
+#include <chrono>
+#include <math.h>
+
+#include "../defines.h"
+#include "hmm_bench_results.h"
+
+namespace hmm_scalar {
+#define HANDMADE_MATH_NO_SSE
+#define HMM_BENCH_ENTRY RunHMMBench
+#define HMM_ACCURACY_ENTRY RunHMMAccuracy
+#define HMM_CHECK_ENTRY RunHMMCheck
+#include "hmm_bench.h"
+}
+
+i32 RunHMMBenchScalar(HMMBenchResult *results, i32 max_results) {
+    return hmm_scalar::RunHMMBench(results, max_results);
+}
+
+i32 RunHMMAccuracyScalar(HMMAccuracyResult *results, i32 max_results) {
+    return hmm_scalar::RunHMMAccuracy(results, max_results);
+}
+
+i32 RunHMMCheckScalar(HMMCheckResult *results, i32 max_results) {
+    return hmm_scalar::RunHMMCheck(results, max_results);
+}
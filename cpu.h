@@ -0,0 +1,210 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include "HandMadeMath.h"
+#include "defines.h"
+
+// Which instruction sets the hot kernels may use, picked once at startup from
+// cpuid instead of at compile time, so one x86-64 build runs the widest
+// variant every machine supports. SSE2 is the x86-64 baseline and what HMM's
+// own SSE paths compile to. Builds without HMM's SSE (or not for x86) stay
+// at that first level, which then runs the scalar code.
+//
+// The variants only use exact operations (no FMA), in the same order per
+// element, so the simulation comes out the same at every level except for
+// the overlap pushes, whose sums get added in a different order.
+
+#if defined(HANDMADE_MATH__USE_SSE) && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_DISPATCH
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#ifdef __clang__
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+// AVX-512F brings FMA along, which GCC would fuse the multiplies and adds into
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+#endif
+
+typedef enum CpuLevel {
+    CPU_LEVEL_SSE2 = 0,
+    CPU_LEVEL_SSE41,  // detected, but nothing uses it yet: runs the SSE2 kernels
+    CPU_LEVEL_AVX2,
+    CPU_LEVEL_AVX512, // AVX-512F
+    CPU_LEVEL_COUNT
+} cpu_level;
+
+static const char *cpu_level_names[CPU_LEVEL_COUNT] = { "sse2", "sse4.1", "avx2", "avx512" };
+
+// Also checks that the OS saves the wider registers (XCR0), a CPU can have
+// AVX that the kernel doesn't enable
+inline CpuLevel DetectCpuLevel() {
+#ifdef CPU_DISPATCH
+    u32 eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return CPU_LEVEL_SSE2;
+    bool sse41 = ecx & bit_SSE4_1;
+    bool avx = (ecx & bit_AVX) && (ecx & bit_OSXSAVE);
+
+    u64 xcr0 = 0;
+    if (avx) {
+        u32 low, high;
+        __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        xcr0 = ((u64)high << 32) | low;
+    }
+    bool ymm_saved = (xcr0 & 0x06) == 0x06; // SSE and AVX state
+    bool zmm_saved = (xcr0 & 0xE6) == 0xE6; // and opmask, upper ZMM, high ZMM
+
+    bool avx2 = false, avx512 = false;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        avx2 = ymm_saved && (ebx & bit_AVX2);
+        avx512 = zmm_saved && (ebx & bit_AVX512F);
+    }
+
+    if (avx512) return CPU_LEVEL_AVX512;
+    if (avx2) return CPU_LEVEL_AVX2;
+    if (sse41) return CPU_LEVEL_SSE41;
+#endif
+    return CPU_LEVEL_SSE2;
+}
+
+inline bool ParseCpuLevel(const char *name, CpuLevel *level) {
+    for (i32 l = 0; l < CPU_LEVEL_COUNT; l++) {
+        if (strcmp(name, cpu_level_names[l]) == 0) {
+            *level = (CpuLevel)l;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct SpatialGrid;
+struct OverlapSolver;
+
+// The hot kernels, one pointer each, bound by BindSimdKernels() before any
+// thread that uses them starts
+struct SimdKernels {
+    CpuLevel level {CPU_LEVEL_SSE2};
+
+    // Integration, see the HMM_*Array functions
+    void (*normalize_vec2_array)(f32 *x, f32 *y, i32 count);
+    void (*add_scaled_vec2_array)(f32 *x, f32 *y, const f32 *dx, const f32 *dy, const f32 *scale, i32 count);
+    void (*length_vec2_array)(const f32 *x, const f32 *y, f32 *out, i32 count);
+
+    // Frustum culling of positions [begin, end): writes the indices inside
+    // all six planes (pushed out by radius[p]) to visible, returns how many
+    i32 (*cull)(const f32 *x, const f32 *y, const f32 *z, i32 begin, i32 end, const hmm_vec4 *planes, const f32 *radius, u32 *visible);
+
+    // Enemy overlap pairs, see ResolvePairs
+    void (*resolve_pairs)(SpatialGrid *grid, OverlapSolver *solver, f32 *out_x, f32 *out_z, u32 i, u32 begin, u32 end);
+
+    // Transform generation, see HMM_InstanceTransforms
+    void (*instance_transforms)(const f32 *x, const f32 *y, const f32 *z, const f32 *scale_x, const f32 *scale_y, const f32 *scale_z,
+                                const f32 *yaw, i32 count, hmm_mat4 *out);
+};
+
+static SimdKernels simd;
+
+#ifdef CPU_DISPATCH
+
+// AVX2 and AVX-512 variants of the HMM array kernels. AVX2 aligns the first
+// array to 32 bytes and leaves the last few to the SSE version; AVX-512 masks
+// the loads and stores of its last iteration instead, and doesn't align since
+// unaligned 512 bit accesses cost next to nothing more on aligned data.
+
+CPU_TARGET_AVX2 static void NormalizeVec2ArrayAVX2(f32 *x, f32 *y, i32 count) {
+    i32 i = 0;
+    for (; i < count && ((size_t)(x + i) & 31); i++) {
+        hmm_v2 v = HMM_NormalizeVec2(HMM_Vec2(x[i], y[i]));
+        x[i] = v.X;
+        y[i] = v.Y;
+    }
+
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m256 vx = _mm256_load_ps(x + i);
+        __m256 vy = _mm256_loadu_ps(y + i);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+        __m256 inverse_length = _mm256_and_ps(_mm256_div_ps(one, length), _mm256_cmp_ps(length, zero, _CMP_NEQ_UQ));
+        _mm256_store_ps(x + i, _mm256_mul_ps(vx, inverse_length));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vy, inverse_length));
+    }
+
+    HMM_NormalizeVec2Array(x + i, y + i, count - i);
+}
+
+CPU_TARGET_AVX2 static void AddScaledVec2ArrayAVX2(f32 *x, f32 *y, const f32 *dx, const f32 *dy, const f32 *scale, i32 count) {
+    i32 i = 0;
+    for (; i < count && ((size_t)(x + i) & 31); i++) {
+        x[i] += dx[i] * scale[i];
+        y[i] += dy[i] * scale[i];
+    }
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 s = _mm256_loadu_ps(scale + i);
+        _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), _mm256_mul_ps(_mm256_loadu_ps(dx + i), s)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(_mm256_loadu_ps(dy + i), s)));
+    }
+
+    HMM_AddScaledVec2Array(x + i, y + i, dx + i, dy + i, scale + i, count - i);
+}
+
+CPU_TARGET_AVX2 static void LengthVec2ArrayAVX2(const f32 *x, const f32 *y, f32 *out, i32 count) {
+    i32 i = 0;
+    for (; i < count && ((size_t)(x + i) & 31); i++) {
+        out[i] = HMM_SquareRootF(x[i] * x[i] + y[i] * y[i]);
+    }
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 vx = _mm256_load_ps(x + i);
+        __m256 vy = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy))));
+    }
+
+    HMM_LengthVec2Array(x + i, y + i, out + i, count - i);
+}
+
+// All lanes for a full iteration, the first `remaining` for the last one
+CPU_TARGET_AVX512 static inline __mmask16 LaneMask16(i32 remaining) {
+    return remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+}
+
+CPU_TARGET_AVX512 static void NormalizeVec2ArrayAVX512(f32 *x, f32 *y, i32 count) {
+    __m512 zero = _mm512_setzero_ps();
+    __m512 one = _mm512_set1_ps(1.0f);
+    for (i32 i = 0; i < count; i += 16) {
+        __mmask16 lanes = LaneMask16(count - i);
+        __m512 vx = _mm512_maskz_loadu_ps(lanes, x + i);
+        __m512 vy = _mm512_maskz_loadu_ps(lanes, y + i);
+        __m512 length = _mm512_maskz_sqrt_ps(lanes, _mm512_add_ps(_mm512_mul_ps(vx, vx), _mm512_mul_ps(vy, vy)));
+        __m512 inverse_length = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(length, zero, _CMP_NEQ_UQ), one, length);
+        _mm512_mask_storeu_ps(x + i, lanes, _mm512_mul_ps(vx, inverse_length));
+        _mm512_mask_storeu_ps(y + i, lanes, _mm512_mul_ps(vy, inverse_length));
+    }
+}
+
+CPU_TARGET_AVX512 static void AddScaledVec2ArrayAVX512(f32 *x, f32 *y, const f32 *dx, const f32 *dy, const f32 *scale, i32 count) {
+    for (i32 i = 0; i < count; i += 16) {
+        __mmask16 lanes = LaneMask16(count - i);
+        __m512 s = _mm512_maskz_loadu_ps(lanes, scale + i);
+        __m512 vx = _mm512_add_ps(_mm512_maskz_loadu_ps(lanes, x + i), _mm512_mul_ps(_mm512_maskz_loadu_ps(lanes, dx + i), s));
+        __m512 vy = _mm512_add_ps(_mm512_maskz_loadu_ps(lanes, y + i), _mm512_mul_ps(_mm512_maskz_loadu_ps(lanes, dy + i), s));
+        _mm512_mask_storeu_ps(x + i, lanes, vx);
+        _mm512_mask_storeu_ps(y + i, lanes, vy);
+    }
+}
+
+CPU_TARGET_AVX512 static void LengthVec2ArrayAVX512(const f32 *x, const f32 *y, f32 *out, i32 count) {
+    for (i32 i = 0; i < count; i += 16) {
+        __mmask16 lanes = LaneMask16(count - i);
+        __m512 vx = _mm512_maskz_loadu_ps(lanes, x + i);
+        __m512 vy = _mm512_maskz_loadu_ps(lanes, y + i);
+        _mm512_mask_storeu_ps(out + i, lanes, _mm512_maskz_sqrt_ps(lanes, _mm512_add_ps(_mm512_mul_ps(vx, vx), _mm512_mul_ps(vy, vy))));
+    }
+}
+
+#endif
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "vendor/raylib/include/raylib.h"
+#include "HandMadeMath.h"
+#include "defines.h"
+#include "cpu.h"
+
+// raylib's default clip distances (RL_CULL_DISTANCE_NEAR/FAR)
+#define CULL_DISTANCE_NEAR 0.01f
+#define CULL_DISTANCE_FAR  1000.0f
+
+// Positions to cull, in SoA so four of them can be tested at once, and the
+// indices of the ones that survived.
+struct CullList {
+    static constexpr i32 max_items {1 << 17};
+
+    i32 count {0};
+    alignas(16) f32 x[max_items];
+    alignas(16) f32 y[max_items];
+    alignas(16) f32 z[max_items];
+
+    i32 visible_count {0};
+    u32 visible[max_items];
+
+
+    void clear() {
+        count = 0;
+        visible_count = 0;
+    }
+
+    void add(Vector3 position) {
+        if (count >= max_items) return;
+        x[count] = position.x;
+        y[count] = position.y;
+        z[count] = position.z;
+        count++;
+    }
+};
+
+// The SSE2 cull kernel: indices in [begin, end) that are no further than
+// radius[p] behind every plane p, see SimdKernels::cull
+static i32 CullPositions(const f32 *x, const f32 *y, const f32 *z, i32 begin, i32 end, const hmm_vec4 *planes, const f32 *radius, u32 *visible) {
+    i32 visible_count = 0;
+    i32 i = begin;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 wide_x[6], wide_y[6], wide_z[6], wide_w[6];
+    for (i32 p = 0; p < 6; p++) {
+        wide_x[p] = _mm_set1_ps(planes[p].X);
+        wide_y[p] = _mm_set1_ps(planes[p].Y);
+        wide_z[p] = _mm_set1_ps(planes[p].Z);
+        wide_w[p] = _mm_set1_ps(planes[p].W + radius[p]); // fold the radius into the offset
+    }
+    __m128 zero = _mm_setzero_ps();
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 wx = _mm_loadu_ps(&x[i]);
+        __m128 wy = _mm_loadu_ps(&y[i]);
+        __m128 wz = _mm_loadu_ps(&z[i]);
+
+        i32 inside = 0xF;
+        for (i32 p = 0; p < 6 && inside; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wide_x[p], wx), _mm_mul_ps(wide_y[p], wy)),
+                                         _mm_add_ps(_mm_mul_ps(wide_z[p], wz), wide_w[p]));
+            inside &= _mm_movemask_ps(_mm_cmpge_ps(distance, zero));
+        }
+
+        while (inside) {
+            i32 lane = __builtin_ctz(inside);
+            visible[visible_count++] = i + lane;
+            inside &= inside - 1;
+        }
+    }
+#endif
+
+    // Tail (or everything, without SSE)
+    for (; i < end; i++) {
+        bool inside = true;
+        for (i32 p = 0; p < 6 && inside; p++) {
+            f32 distance = planes[p].X * x[i] + planes[p].Y * y[i] + planes[p].Z * z[i] + planes[p].W + radius[p];
+            inside = distance >= 0;
+        }
+        if (inside) {
+            visible[visible_count++] = i;
+        }
+    }
+
+    return visible_count;
+}
+
+#ifdef CPU_DISPATCH
+// Same plane tests 8 wide, the rest goes to CullPositions
+CPU_TARGET_AVX2 static i32 CullPositionsAVX2(const f32 *x, const f32 *y, const f32 *z, i32 begin, i32 end, const hmm_vec4 *planes, const f32 *radius, u32 *visible) {
+    __m256 wide_x[6], wide_y[6], wide_z[6], wide_w[6];
+    for (i32 p = 0; p < 6; p++) {
+        wide_x[p] = _mm256_set1_ps(planes[p].X);
+        wide_y[p] = _mm256_set1_ps(planes[p].Y);
+        wide_z[p] = _mm256_set1_ps(planes[p].Z);
+        wide_w[p] = _mm256_set1_ps(planes[p].W + radius[p]);
+    }
+    __m256 zero = _mm256_setzero_ps();
+
+    i32 visible_count = 0;
+    i32 i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 wx = _mm256_loadu_ps(&x[i]);
+        __m256 wy = _mm256_loadu_ps(&y[i]);
+        __m256 wz = _mm256_loadu_ps(&z[i]);
+
+        i32 inside = 0xFF;
+        for (i32 p = 0; p < 6 && inside; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wide_x[p], wx), _mm256_mul_ps(wide_y[p], wy)),
+                                            _mm256_add_ps(_mm256_mul_ps(wide_z[p], wz), wide_w[p]));
+            inside &= _mm256_movemask_ps(_mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+        }
+
+        while (inside) {
+            i32 lane = __builtin_ctz(inside);
+            visible[visible_count++] = i + lane;
+            inside &= inside - 1;
+        }
+    }
+
+    return visible_count + CullPositions(x, y, z, i, end, planes, radius, visible + visible_count);
+}
+
+// 16 wide, the last iteration masked, and the survivors written with one
+// compress store instead of a loop over the mask bits
+CPU_TARGET_AVX512 static i32 CullPositionsAVX512(const f32 *x, const f32 *y, const f32 *z, i32 begin, i32 end, const hmm_vec4 *planes, const f32 *radius, u32 *visible) {
+    __m512 wide_x[6], wide_y[6], wide_z[6], wide_w[6];
+    for (i32 p = 0; p < 6; p++) {
+        wide_x[p] = _mm512_set1_ps(planes[p].X);
+        wide_y[p] = _mm512_set1_ps(planes[p].Y);
+        wide_z[p] = _mm512_set1_ps(planes[p].Z);
+        wide_w[p] = _mm512_set1_ps(planes[p].W + radius[p]);
+    }
+    __m512 zero = _mm512_setzero_ps();
+    __m512i lane_index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    i32 visible_count = 0;
+    for (i32 i = begin; i < end; i += 16) {
+        __mmask16 inside = LaneMask16(end - i);
+        __m512 wx = _mm512_maskz_loadu_ps(inside, &x[i]);
+        __m512 wy = _mm512_maskz_loadu_ps(inside, &y[i]);
+        __m512 wz = _mm512_maskz_loadu_ps(inside, &z[i]);
+
+        for (i32 p = 0; p < 6 && inside; p++) {
+            __m512 distance = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(wide_x[p], wx), _mm512_mul_ps(wide_y[p], wy)),
+                                            _mm512_add_ps(_mm512_mul_ps(wide_z[p], wz), wide_w[p]));
+            inside = _mm512_mask_cmp_ps_mask(inside, distance, zero, _CMP_GE_OQ);
+        }
+
+        _mm512_mask_compressstoreu_epi32(&visible[visible_count], inside, _mm512_add_epi32(_mm512_set1_epi32(i), lane_index));
+        visible_count += __builtin_popcount(inside);
+    }
+
+    return visible_count;
+}
+#endif
+
+struct Frustum {
+    // xyz is the inward normal, a point p is inside when dot(xyz, p) + w >= 0
+    hmm_vec4 planes[6];
+
+
+    // Same projection and view raylib builds for BeginMode3D(camera)
+    void fromCamera(Camera3D camera, f32 aspect_ratio) {
+        hmm_mat4 projection = HMM_Perspective(camera.fovy, aspect_ratio, CULL_DISTANCE_NEAR, CULL_DISTANCE_FAR);
+        hmm_mat4 view = HMM_LookAt(
+            HMM_Vec3(camera.position.x, camera.position.y, camera.position.z),
+            HMM_Vec3(camera.target.x, camera.target.y, camera.target.z),
+            HMM_Vec3(camera.up.x, camera.up.y, camera.up.z));
+        hmm_mat4 m = HMM_MultiplyMat4(projection, view);
+
+        // Gribb/Hartmann: planes are the last row plus or minus the others
+        for (i32 axis = 0; axis < 3; axis++) {
+            for (i32 side = 0; side < 2; side++) {
+                f32 sign = side ? -1.0f : 1.0f;
+                hmm_vec4 plane;
+                for (i32 column = 0; column < 4; column++) {
+                    plane.Elements[column] = m.Elements[column][3] + sign * m.Elements[column][axis];
+                }
+
+                f32 length = HMM_LengthVec3(plane.XYZ);
+                planes[axis * 2 + side] = HMM_DivideVec4f(plane, length);
+            }
+        }
+    }
+
+    // Axis aligned boxes around the positions, all with the same half extents
+    void cullBoxes(CullList *list, hmm_vec3 half_extents) {
+        f32 radius[6];
+        for (i32 p = 0; p < 6; p++) {
+            radius[p] = fabsf(planes[p].X) * half_extents.X
+                      + fabsf(planes[p].Y) * half_extents.Y
+                      + fabsf(planes[p].Z) * half_extents.Z;
+        }
+        cull(list, radius);
+    }
+
+    void cullSpheres(CullList *list, f32 sphere_radius) {
+        f32 radius[6];
+        for (i32 p = 0; p < 6; p++) {
+            radius[p] = sphere_radius;
+        }
+        cull(list, radius);
+    }
+
+    // Keeps the positions that are no further than radius[p] behind every plane p
+    void cull(CullList *list, f32 *radius) {
+        list->visible_count = simd.cull(list->x, list->y, list->z, 0, list->count, planes, radius, list->visible);
+    }
+};
@@ -0,0 +1,436 @@
+#pragma once
+
+#include "vendor/raylib/include/raylib.h"
+#include "HandMadeMath.h"
+#include "defines.h"
+#include "jobs.h"
+
+// Shared flow field towards a single target (the player).
+// Every enemy steers with one lookup into the front buffer's `directions`, so
+// the cost is bound by grid size, not enemy count.
+//
+// The field is only rebuilt when the target moves to another cell. A rebuild
+// runs in the background on the job system and writes the back buffer, while
+// enemies keep sampling the front buffer; the buffers swap once it's done.
+//
+// The rebuild is a tiled wavefront: each round, the active tiles pull
+// distances across their border from the halo, run a local BFS, and the ones
+// that changed publish their border cells into the halo. Neighbours of changed
+// tiles become active for the next round, until nothing changes anymore.
+
+#define FLOW_FIELD_UNREACHABLE 0xFFFF
+#define FLOW_FIELD_TILE_SIZE 16
+
+struct FlowField {
+    static constexpr i32 width  {128};  // cells
+    static constexpr i32 height {128};  // cells
+    static constexpr i32 cell_count {width * height};
+
+    static constexpr i32 tiles_x {width  / FLOW_FIELD_TILE_SIZE};
+    static constexpr i32 tiles_z {height / FLOW_FIELD_TILE_SIZE};
+    static constexpr i32 tile_count {tiles_x * tiles_z};
+    static constexpr i32 tile_cells {FLOW_FIELD_TILE_SIZE * FLOW_FIELD_TILE_SIZE};
+
+    // Integer step costs, so straight and diagonal moves keep roughly the right ratio
+    static constexpr u16 cost_straight {10};
+    static constexpr u16 cost_diagonal {14};
+
+    // The 8 neighbour steps; `steps` holds one bit per entry for every cell
+    static constexpr i32 step_dx[8]   {-1, 0, 1, -1, 1, -1, 0, 1};
+    static constexpr i32 step_dz[8]   {-1, -1, -1, 0, 0, 1, 1, 1};
+    static constexpr u16 step_cost[8] {cost_diagonal, cost_straight, cost_diagonal, cost_straight, cost_straight, cost_diagonal, cost_straight, cost_diagonal};
+
+    // What a cell's direction becomes when its best step is k, unit length
+    static constexpr f32 diagonal_scale {0.70710678f};
+    static constexpr hmm_v2 step_direction[8] {
+        HMM_ConstMultiplyVec2f(HMM_ConstVec2(-1, -1), diagonal_scale), HMM_ConstVec2(0, -1), HMM_ConstMultiplyVec2f(HMM_ConstVec2(1, -1), diagonal_scale),
+        HMM_ConstVec2(-1, 0),                                                                   HMM_ConstVec2(1, 0),
+        HMM_ConstMultiplyVec2f(HMM_ConstVec2(-1, 1), diagonal_scale),  HMM_ConstVec2(0, 1),  HMM_ConstMultiplyVec2f(HMM_ConstVec2(1, 1), diagonal_scale),
+    };
+
+    struct Buffer {
+        i32 target_cell {-1};
+        u16    distance[cell_count];
+        hmm_v2 directions[cell_count] {}; // zero until the first build lands: steer straight
+    };
+
+    struct Tile {
+        i32  queue[tile_cells];
+        bool queued[tile_cells];
+        bool seeded;
+        bool active;
+        bool changed;
+    };
+
+    f32 cell_size {2.0f};
+    Vector3 origin {-128.0f, 0, -128.0f}; // world position of the corner of cell (0, 0)
+
+    bool blocked[cell_count] {};
+    u8   steps[cell_count]; // allowed neighbour steps, derived from `blocked`
+
+    Buffer buffers[2];
+    i32 front {0};
+
+    bool dirty {true}; // forces a rebuild, set it after changing `blocked`
+    bool building {false};
+    JobCounter build_counter;
+    JobSystem *jobs {nullptr};
+
+    // Wavefront scratch, only touched by the build in flight
+    u16  halo[cell_count];
+    Tile tiles[tile_count];
+
+
+    i32 cellX(f32 x) { return (i32)floorf((x - origin.x) / cell_size); }
+    i32 cellZ(f32 z) { return (i32)floorf((z - origin.z) / cell_size); }
+
+    bool inside(i32 cx, i32 cz) {
+        return cx >= 0 && cx < width && cz >= 0 && cz < height;
+    }
+
+    // Steps into blocked cells, or diagonally past a blocked corner, are not allowed
+    bool canStep(i32 cx, i32 cz, i32 dx, i32 dz) {
+        i32 nx = cx + dx;
+        i32 nz = cz + dz;
+        if (!inside(nx, nz)) return false;
+        if (blocked[nz * width + nx]) return false;
+        if (dx && dz && (blocked[cz * width + nx] || blocked[nz * width + cx])) return false;
+        return true;
+    }
+
+    void computeSteps() {
+        for (i32 cz = 0; cz < height; cz++) {
+            for (i32 cx = 0; cx < width; cx++) {
+                u8 mask = 0;
+                for (i32 k = 0; k < 8; k++) {
+                    if (canStep(cx, cz, step_dx[k], step_dz[k])) mask |= 1 << k;
+                }
+                steps[cz * width + cx] = mask;
+            }
+        }
+    }
+
+    i32 cellIndex(Vector3 pos) {
+        i32 cx = cellX(pos.x);
+        i32 cz = cellZ(pos.z);
+        if (!inside(cx, cz)) return -1;
+        return cz * width + cx;
+    }
+
+    // Walks the segment in half-cell steps; positions outside the field count as open.
+    bool lineOfSight(Vector3 from, Vector3 to) {
+        f32 x = to.x - from.x;
+        f32 z = to.z - from.z;
+        f32 length = sqrtf(x * x + z * z);
+        i32 steps = (i32)(length / (cell_size * 0.5f)) + 1;
+
+        for (i32 i = 0; i <= steps; i++) {
+            f32 t = (f32)i / (f32)steps;
+            i32 index = cellIndex({from.x + x * t, 0, from.z + z * t});
+            if (index >= 0 && blocked[index]) return false;
+        }
+        return true;
+    }
+
+    // Returns the unit direction to follow from `pos`, or a zero vector when
+    // pos is outside the field, in the target cell or cut off from the target.
+    hmm_v2 sample(Vector3 pos) {
+        i32 index = cellIndex(pos);
+        if (index < 0) return {0, 0};
+        return buffers[front].directions[index];
+    }
+
+    // Call once per frame. Swaps in a finished build and starts a new one
+    // when the target left the cell the front buffer was built for.
+    void update(Vector3 target, JobSystem *job_system) {
+        if (building) {
+            if (!build_counter.done()) return;
+            building = false;
+            front ^= 1;
+        }
+
+        // Clamp the target onto the field so enemies still flow towards the
+        // edge closest to a player who walked out of the arena.
+        i32 tx = HMM_MAX(0, HMM_MIN(width  - 1, cellX(target.x)));
+        i32 tz = HMM_MAX(0, HMM_MIN(height - 1, cellZ(target.z)));
+        i32 target_cell = tz * width + tx;
+
+        if (!dirty && target_cell == buffers[front].target_cell) return;
+        if (dirty) {
+            computeSteps();
+            dirty = false;
+        }
+
+        jobs = job_system;
+        buffers[front ^ 1].target_cell = target_cell;
+
+        if (jobs && jobs->worker_count) {
+            building = true;
+            jobs->run(buildJob, this, &build_counter);
+        }
+        else {
+            build();
+            front ^= 1;
+        }
+    }
+
+    static void buildJob(void *data, i32, i32) {
+        ((FlowField *)data)->build();
+    }
+
+    // Fills the back buffer for its target_cell.
+    void build() {
+        Buffer *back = &buffers[front ^ 1];
+
+        forTiles(resetTiles);
+
+        i32 target = back->target_cell;
+        back->distance[target] = 0;
+        Tile *target_tile = &tiles[tileOf(target % width, target / width)];
+        target_tile->seeded = true;
+        target_tile->active = true;
+
+        bool active = true;
+        while (active) {
+            forTiles(propagateTiles);
+            forTiles(publishTiles);
+
+            for (i32 t = 0; t < tile_count; t++) {
+                tiles[t].active = false;
+            }
+
+            active = false;
+            for (i32 t = 0; t < tile_count; t++) {
+                if (!tiles[t].changed) continue;
+
+                i32 tx = t % tiles_x;
+                i32 tz = t / tiles_x;
+                for (i32 dz = -1; dz <= 1; dz++) {
+                    for (i32 dx = -1; dx <= 1; dx++) {
+                        i32 nx = tx + dx;
+                        i32 nz = tz + dz;
+                        if ((!dx && !dz) || nx < 0 || nx >= tiles_x || nz < 0 || nz >= tiles_z) continue;
+                        tiles[nz * tiles_x + nx].active = true;
+                        active = true;
+                    }
+                }
+            }
+        }
+
+        forTiles(directionTiles);
+    }
+
+    void forTiles(JobFunc *func) {
+        if (jobs) {
+            jobs->parallelFor(tile_count, 1, func, this);
+        }
+        else {
+            func(this, 0, tile_count);
+        }
+    }
+
+    i32 tileOf(i32 cx, i32 cz) {
+        return (cz / FLOW_FIELD_TILE_SIZE) * tiles_x + (cx / FLOW_FIELD_TILE_SIZE);
+    }
+
+    static void resetTiles(void *data, i32 begin, i32 end) {
+        FlowField *field = (FlowField *)data;
+        Buffer *back = &field->buffers[field->front ^ 1];
+
+        for (i32 t = begin; t < end; t++) {
+            i32 x0 = (t % tiles_x) * FLOW_FIELD_TILE_SIZE;
+            i32 z0 = (t / tiles_x) * FLOW_FIELD_TILE_SIZE;
+            for (i32 cz = z0; cz < z0 + FLOW_FIELD_TILE_SIZE; cz++) {
+                for (i32 cx = x0; cx < x0 + FLOW_FIELD_TILE_SIZE; cx++) {
+                    i32 index = cz * width + cx;
+                    back->distance[index] = FLOW_FIELD_UNREACHABLE;
+                    field->halo[index] = FLOW_FIELD_UNREACHABLE;
+                }
+            }
+
+            Tile *tile = &field->tiles[t];
+            for (i32 i = 0; i < tile_cells; i++) tile->queued[i] = false;
+            tile->seeded = false;
+            tile->active = false;
+            tile->changed = false;
+        }
+    }
+
+    static void propagateTiles(void *data, i32 begin, i32 end) {
+        FlowField *field = (FlowField *)data;
+        for (i32 t = begin; t < end; t++) {
+            field->propagateTile(t);
+        }
+    }
+
+    // One wavefront round for one tile. Only reads the halo and only writes
+    // this tile's own cells, so tiles can run concurrently.
+    void propagateTile(i32 t) {
+        Buffer *back = &buffers[front ^ 1];
+        u16 *distance = back->distance;
+
+        Tile *tile = &tiles[t];
+        tile->changed = false;
+        if (!tile->active) return;
+
+        i32 x0 = (t % tiles_x) * FLOW_FIELD_TILE_SIZE;
+        i32 z0 = (t / tiles_x) * FLOW_FIELD_TILE_SIZE;
+        i32 x1 = x0 + FLOW_FIELD_TILE_SIZE;
+        i32 z1 = z0 + FLOW_FIELD_TILE_SIZE;
+
+        // Ring buffer: a cell is queued at most once at a time, so tile_cells slots suffice
+        i32 head = 0;
+        i32 count = 0;
+        auto enqueue = [&] (i32 cx, i32 cz) {
+            i32 local = (cz - z0) * FLOW_FIELD_TILE_SIZE + (cx - x0);
+            if (tile->queued[local]) return;
+            tile->queued[local] = true;
+            tile->queue[(head + count) % tile_cells] = local;
+            count++;
+        };
+
+        if (tile->seeded) {
+            i32 target = back->target_cell;
+            enqueue(target % width, target / width);
+            tile->seeded = false;
+        }
+
+        // Pull from the neighbouring tiles' borders
+        for (i32 cz = z0; cz < z1; cz++) {
+            for (i32 cx = x0; cx < x1; cx++) {
+                bool on_border = cx == x0 || cx == x1 - 1 || cz == z0 || cz == z1 - 1;
+                if (!on_border) {
+                    cx = x1 - 2; // skip the interior of this row
+                    continue;
+                }
+
+                i32 index = cz * width + cx;
+                if (blocked[index]) continue;
+
+                u8 mask = steps[index];
+                for (i32 k = 0; k < 8; k++) {
+                    if (!(mask & (1 << k))) continue;
+
+                    i32 nx = cx + step_dx[k];
+                    i32 nz = cz + step_dz[k];
+                    bool outside_tile = nx < x0 || nx >= x1 || nz < z0 || nz >= z1;
+                    if (!outside_tile) continue;
+
+                    u32 d = halo[nz * width + nx] + step_cost[k];
+                    if (d < distance[index]) {
+                        distance[index] = (u16)d;
+                        enqueue(cx, cz);
+                    }
+                }
+            }
+        }
+
+        tile->changed = count > 0;
+
+        // Local label-correcting BFS with 8-neighbour step costs
+        while (count) {
+            i32 local = tile->queue[head];
+            head = (head + 1) % tile_cells;
+            count--;
+            tile->queued[local] = false;
+
+            i32 cx = x0 + local % FLOW_FIELD_TILE_SIZE;
+            i32 cz = z0 + local / FLOW_FIELD_TILE_SIZE;
+            i32 index = cz * width + cx;
+            u32 base = distance[index];
+
+            u8 mask = steps[index];
+            for (i32 k = 0; k < 8; k++) {
+                if (!(mask & (1 << k))) continue;
+
+                i32 nx = cx + step_dx[k];
+                i32 nz = cz + step_dz[k];
+                if (nx < x0 || nx >= x1 || nz < z0 || nz >= z1) continue;
+
+                i32 neighbour = nz * width + nx;
+                u32 d = base + step_cost[k];
+                if (d < distance[neighbour]) {
+                    distance[neighbour] = (u16)d;
+                    enqueue(nx, nz);
+                }
+            }
+        }
+    }
+
+    static void publishTiles(void *data, i32 begin, i32 end) {
+        FlowField *field = (FlowField *)data;
+        for (i32 t = begin; t < end; t++) {
+            field->publishTile(t);
+        }
+    }
+
+    // Copies the border of a changed tile into the halo, after every tile
+    // finished reading it this round.
+    void publishTile(i32 t) {
+        if (!tiles[t].changed) return;
+
+        Buffer *back = &buffers[front ^ 1];
+        i32 x0 = (t % tiles_x) * FLOW_FIELD_TILE_SIZE;
+        i32 z0 = (t / tiles_x) * FLOW_FIELD_TILE_SIZE;
+        i32 x1 = x0 + FLOW_FIELD_TILE_SIZE - 1;
+        i32 z1 = z0 + FLOW_FIELD_TILE_SIZE - 1;
+
+        for (i32 i = 0; i < FLOW_FIELD_TILE_SIZE; i++) {
+            i32 top    = z0 * width + x0 + i;
+            i32 bottom = z1 * width + x0 + i;
+            i32 left   = (z0 + i) * width + x0;
+            i32 right  = (z0 + i) * width + x1;
+            halo[top]    = back->distance[top];
+            halo[bottom] = back->distance[bottom];
+            halo[left]   = back->distance[left];
+            halo[right]  = back->distance[right];
+        }
+    }
+
+    static void directionTiles(void *data, i32 begin, i32 end) {
+        FlowField *field = (FlowField *)data;
+        for (i32 t = begin; t < end; t++) {
+            field->computeDirections(t);
+        }
+    }
+
+    // Every cell points at its cheapest neighbour.
+    void computeDirections(i32 t) {
+        Buffer *back = &buffers[front ^ 1];
+        i32 x0 = (t % tiles_x) * FLOW_FIELD_TILE_SIZE;
+        i32 z0 = (t / tiles_x) * FLOW_FIELD_TILE_SIZE;
+
+        for (i32 cz = z0; cz < z0 + FLOW_FIELD_TILE_SIZE; cz++) {
+            for (i32 cx = x0; cx < x0 + FLOW_FIELD_TILE_SIZE; cx++) {
+                i32 index = cz * width + cx;
+                hmm_v2 dir = {0, 0};
+
+                if (index != back->target_cell && back->distance[index] != FLOW_FIELD_UNREACHABLE) {
+                    u16 best = back->distance[index];
+                    i32 best_step = -1;
+                    u8 mask = steps[index];
+                    for (i32 k = 0; k < 8; k++) {
+                        if (!(mask & (1 << k))) continue;
+
+                        u16 d = back->distance[(cz + step_dz[k]) * width + (cx + step_dx[k])];
+                        if (d < best) {
+                            best = d;
+                            best_step = k;
+                        }
+                    }
+                    if (best_step >= 0) dir = step_direction[best_step];
+                }
+
+                back->directions[index] = dir;
+            }
+        }
+    }
+};
+
+// The baked directions: straight steps exact, diagonals unit length
+static_assert(FlowField::step_direction[1].X == 0.0f && FlowField::step_direction[1].Y == -1.0f, "step 1 must be -z");
+static_assert(FlowField::step_direction[4].X == 1.0f && FlowField::step_direction[4].Y == 0.0f, "step 4 must be +x");
+static_assert(FlowField::step_direction[0].X == -FlowField::diagonal_scale && FlowField::step_direction[0].Y == -FlowField::diagonal_scale,
+              "step 0 must be the -x -z diagonal");
+static_assert(FlowField::step_direction[7].X == FlowField::diagonal_scale && FlowField::step_direction[7].Y == FlowField::diagonal_scale,
+              "step 7 must be the +x +z diagonal");
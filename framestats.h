@@ -0,0 +1,233 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vendor/raylib/include/raylib.h"
+#include "HandMadeMath.h"
+#include "defines.h"
+#include "allocations.h"
+#include "profiler.h"
+
+// Durations in microseconds, log-linear like an HDR histogram: exact below
+// 32us, then 16 sub-buckets per power of two, so every value is kept to
+// within 1/16 of itself. Covers 1us to ~70 minutes in a fixed 464 slots.
+struct DurationHistogram {
+    static constexpr i32 linear_bits {5};
+    static constexpr i32 half_linear {1 << (linear_bits - 1)};
+    static constexpr i32 slot_count {(32 - linear_bits + 2) * half_linear};
+
+    u32 counts[slot_count] {};
+    i64 total {0};
+    f64 sum {0};  // microseconds
+    u32 max {0};  // microseconds, exact
+
+
+    static i32 slot(u32 us) {
+        if (us < (1u << linear_bits)) return (i32)us;
+        i32 shift = (31 - __builtin_clz(us)) - (linear_bits - 1);
+        return shift * half_linear + (i32)(us >> shift);
+    }
+
+    // Largest value that lands in `index`
+    static u64 highestInSlot(i32 index) {
+        if (index < (1 << linear_bits)) return (u64)index;
+        i32 shift = index / half_linear - 1;
+        u64 sub = (u64)(index - shift * half_linear);
+        return ((sub + 1) << shift) - 1;
+    }
+
+    void clear() {
+        for (i32 i = 0; i < slot_count; i++) {
+            counts[i] = 0;
+        }
+        total = 0;
+        sum = 0;
+        max = 0;
+    }
+
+    void record(u32 us) {
+        counts[slot(us)]++;
+        total++;
+        sum += us;
+        max = HMM_MAX(max, us);
+    }
+
+    // p in 0..100. Reports the top of the value's slot, never more than max.
+    u32 percentile(f64 p) {
+        if (total == 0) return 0;
+
+        i64 rank = (i64)(p / 100.0 * total + 0.5);
+        rank = HMM_MAX(rank, 1);
+        i64 seen = 0;
+        for (i32 i = 0; i < slot_count; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return (u32)HMM_MIN(highestInSlot(i), (u64)max);
+            }
+        }
+        return max;
+    }
+};
+
+typedef enum FrameStage {
+    FRAME_STAGE_FRAME = 0,  // the whole frame, present to present
+    FRAME_STAGE_SIMULATE,   // the fixed steps of UpdateGame
+    FRAME_STAGE_BUILD,      // RenderGame filling the command buffer
+    FRAME_STAGE_SUBMIT,     // the backend sorting and drawing it
+    FRAME_STAGE_COUNT
+} frame_stage;
+
+static const char *frame_stage_names[FRAME_STAGE_COUNT] = { "frame", "simulate", "build", "submit" };
+
+// Per stage histograms and heap allocations since start, plus the last frame
+// times for counting hitches (frames over hitch_ms) over the last windows[i]
+// frames.
+struct FrameStats {
+    static constexpr i32 history {4096}; // frames; the largest useful window
+    static constexpr i32 max_windows {4};
+
+    f32 hitch_ms {1000.0f / 30.0f};
+    i32 windows[max_windows] {60, 600, 3600};
+    i32 window_count {3};
+
+    DurationHistogram stages[FRAME_STAGE_COUNT];
+    AllocationCount allocations[FRAME_STAGE_COUNT] {};
+    i64 max_allocations[FRAME_STAGE_COUNT] {}; // in one frame
+
+    f32 frame_ms[history]; // ring, the newest at (frame_count - 1) % history
+    i64 frame_count {0};
+    i64 hitch_count {0};   // since start
+
+    Profiler *profiler {nullptr}; // scopes to report along with the stages, if set
+
+
+    void clear() {
+        for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+            stages[s].clear();
+            allocations[s] = {};
+            max_allocations[s] = 0;
+        }
+        frame_count = 0;
+        hitch_count = 0;
+    }
+
+    void record(FrameStage stage, f32 ms) {
+        stages[stage].record((u32)HMM_MAX(ms * 1000.0f, 0.0f));
+
+        if (stage == FRAME_STAGE_FRAME) {
+            frame_ms[frame_count % history] = ms;
+            frame_count++;
+            if (ms > hitch_ms) hitch_count++;
+        }
+    }
+
+    void recordAllocations(FrameStage stage, AllocationCount allocated) {
+        allocations[stage].count += allocated.count;
+        allocations[stage].bytes += allocated.bytes;
+        max_allocations[stage] = HMM_MAX(max_allocations[stage], allocated.count);
+    }
+
+    f32 percentileMs(FrameStage stage, f64 p) { return stages[stage].percentile(p) / 1000.0f; }
+    f32 maxMs(FrameStage stage)               { return stages[stage].max / 1000.0f; }
+    f32 meanMs(FrameStage stage)              { return stages[stage].total ? (f32)(stages[stage].sum / stages[stage].total / 1000.0) : 0.0f; }
+
+    // Hitches among the last `frames` frames
+    i32 hitches(i32 frames) {
+        i64 n = HMM_MIN(HMM_MIN((i64)frames, frame_count), (i64)history);
+        i32 count = 0;
+        for (i64 i = frame_count - n; i < frame_count; i++) {
+            if (frame_ms[i % history] > hitch_ms) count++;
+        }
+        return count;
+    }
+
+    void drawOverlay(i32 x, i32 y, i32 font_size, Color color) {
+        for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+            FrameStage stage = (FrameStage)s;
+            DrawText(TextFormat("%-8s p50 %6.2f  p95 %6.2f  p99 %6.2f  max %6.2f ms", frame_stage_names[s],
+                percentileMs(stage, 50), percentileMs(stage, 95), percentileMs(stage, 99), maxMs(stage)), x, y, font_size, color);
+            y += font_size + 2;
+        }
+
+        char line[256];
+        i32 length = snprintf(line, sizeof(line), "hitches > %.1f ms:", hitch_ms);
+        for (i32 w = 0; w < window_count && length < (i32)sizeof(line); w++) {
+            length += snprintf(line + length, sizeof(line) - length, " %d in %d,", hitches(windows[w]), windows[w]);
+        }
+        if (length < (i32)sizeof(line)) {
+            snprintf(line + length, sizeof(line) - length, " %lld total", (long long)hitch_count);
+        }
+        DrawText(line, x, y, font_size, color);
+        y += font_size + 2;
+
+        DrawText(TextFormat("most allocations in a frame: simulate %lld  build %lld  submit %lld  frame %lld",
+            (long long)max_allocations[FRAME_STAGE_SIMULATE], (long long)max_allocations[FRAME_STAGE_BUILD],
+            (long long)max_allocations[FRAME_STAGE_SUBMIT], (long long)max_allocations[FRAME_STAGE_FRAME]), x, y, font_size, color);
+    }
+
+    void print(FILE *out) {
+        for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+            FrameStage stage = (FrameStage)s;
+            fprintf(out, "%-8s p50 %.3f p95 %.3f p99 %.3f max %.3f mean %.3f ms, %lld allocations (%lld bytes, at most %lld in a frame)\n", frame_stage_names[s],
+                percentileMs(stage, 50), percentileMs(stage, 95), percentileMs(stage, 99), maxMs(stage), meanMs(stage),
+                (long long)allocations[s].count, (long long)allocations[s].bytes, (long long)max_allocations[s]);
+        }
+        fprintf(out, "hitches > %.1f ms:", hitch_ms);
+        for (i32 w = 0; w < window_count; w++) {
+            fprintf(out, " %d in last %d,", hitches(windows[w]), windows[w]);
+        }
+        fprintf(out, " %lld of %lld total\n", (long long)hitch_count, (long long)frame_count);
+
+        if (profiler) profiler->print(out);
+    }
+
+    // One row per stage
+    void writeCsv(FILE *out) {
+        fprintf(out, "stage,count,p50_ms,p95_ms,p99_ms,max_ms,mean_ms,allocations,allocated_bytes,max_frame_allocations\n");
+        for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+            FrameStage stage = (FrameStage)s;
+            fprintf(out, "%s,%lld,%.4f,%.4f,%.4f,%.4f,%.4f,%lld,%lld,%lld\n", frame_stage_names[s], (long long)stages[s].total,
+                percentileMs(stage, 50), percentileMs(stage, 95), percentileMs(stage, 99), maxMs(stage), meanMs(stage),
+                (long long)allocations[s].count, (long long)allocations[s].bytes, (long long)max_allocations[s]);
+        }
+    }
+
+    void writeJson(FILE *out) {
+        fprintf(out, "{\n  \"frames\": %lld,\n  \"stages\": {\n", (long long)frame_count);
+        for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+            FrameStage stage = (FrameStage)s;
+            fprintf(out, "    \"%s\": {\"count\": %lld, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, \"mean_ms\": %.4f, "
+                "\"allocations\": %lld, \"allocated_bytes\": %lld, \"max_frame_allocations\": %lld}%s\n",
+                frame_stage_names[s], (long long)stages[s].total,
+                percentileMs(stage, 50), percentileMs(stage, 95), percentileMs(stage, 99), maxMs(stage), meanMs(stage),
+                (long long)allocations[s].count, (long long)allocations[s].bytes, (long long)max_allocations[s],
+                s + 1 < FRAME_STAGE_COUNT ? "," : "");
+        }
+        fprintf(out, "  },\n  \"hitch_ms\": %.3f,\n  \"hitches\": {", hitch_ms);
+        for (i32 w = 0; w < window_count; w++) {
+            fprintf(out, "\"last_%d\": %d, ", windows[w], hitches(windows[w]));
+        }
+        fprintf(out, "\"total\": %lld}", (long long)hitch_count);
+        if (profiler) {
+            fprintf(out, ",\n");
+            profiler->writeJson(out);
+        }
+        fprintf(out, "\n}\n");
+    }
+
+    // Format from the extension: .csv, anything else is JSON
+    bool write(const char *path) {
+        FILE *out = fopen(path, "w");
+        if (!out) return false;
+
+        const char *extension = strrchr(path, '.');
+        if (extension && strcmp(extension, ".csv") == 0) {
+            writeCsv(out);
+        } else {
+            writeJson(out);
+        }
+        fclose(out);
+        return true;
+    }
+};
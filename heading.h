@@ -0,0 +1,60 @@
+#pragma once
+
+#include "HandMadeMath.h"
+#include "defines.h"
+
+// Directions in the xz plane quantized to one of HEADING_COUNT angles, so one
+// fits in a u8 instead of two floats. Heading k points k * heading_radians
+// from +x towards +z; its unit vector is in heading_table, which is worked
+// out at compile time. Neighbouring headings are 1.4 degrees apart.
+
+#define HEADING_BITS 8
+#define HEADING_COUNT (1 << HEADING_BITS)
+
+static constexpr f32 heading_radians {2.0f * HMM_PI32 / HEADING_COUNT};
+
+struct HeadingTable {
+    f32 x[HEADING_COUNT];
+    f32 z[HEADING_COUNT];
+};
+
+constexpr HeadingTable MakeHeadingTable() {
+    HeadingTable table {};
+    for (i32 k = 0; k < HEADING_COUNT; k++) {
+        hmm_v2 sin_cos = HMM_ConstSinCosF(k * heading_radians);
+        table.x[k] = sin_cos.Y;
+        table.z[k] = sin_cos.X;
+    }
+    return table;
+}
+
+static constexpr HeadingTable heading_table = MakeHeadingTable();
+
+// The axes come out exact and the diagonals right to the last bit or so; if
+// HMM_ConstSinCosF drifts, this stops the build. hmm_bench --check compares
+// the whole table with SinCosApproxF.
+static_assert(heading_table.x[0] == 1.0f && heading_table.z[0] == 0.0f, "heading 0 must be +x");
+static_assert(heading_table.z[HEADING_COUNT / 4] == 1.0f, "a quarter turn must be +z");
+static_assert(heading_table.x[HEADING_COUNT / 2] == -1.0f, "half a turn must be -x");
+static_assert(heading_table.z[HEADING_COUNT * 3 / 4] == -1.0f, "three quarters must be -z");
+static_assert(heading_table.x[HEADING_COUNT / 8] > 0.7071067f && heading_table.x[HEADING_COUNT / 8] < 0.7071069f &&
+              heading_table.z[HEADING_COUNT / 8] > 0.7071067f && heading_table.z[HEADING_COUNT / 8] < 0.7071069f,
+              "an eighth of a turn must be the diagonal");
+
+// Nearest heading to an angle in radians, any angle
+inline u8 HeadingFromAngle(f32 radians) {
+    return (u8)(HMM_ApproxRound(radians * (1.0f / heading_radians)) & (HEADING_COUNT - 1));
+}
+
+// Nearest heading to (x, z), which needn't be normalized. (0, 0) gives heading 0.
+inline u8 QuantizeHeading(f32 x, f32 z) {
+    return HeadingFromAngle(HMM_ATan2ApproxF(z, x));
+}
+
+// QuantizeHeading for count directions; angles is scratch for count floats
+inline void QuantizeHeadingArray(const f32 *x, const f32 *z, f32 *angles, u8 *out, i32 count) {
+    HMM_ATan2FArray(z, x, angles, count);
+    for (i32 i = 0; i < count; i++) {
+        out[i] = HeadingFromAngle(angles[i]);
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "HandMadeMath.h"
+#include "defines.h"
+
+struct GameInput {
+    i8 button_a;
+    i8 button_b;
+    i8 button_x;
+    i8 button_y;
+
+    i8 button_start;
+    i8 button_back;
+
+    struct AxisLeft {
+        f32 x;
+        f32 y;
+    } axis_left;
+
+    struct AxisRight {
+        f32 x;
+        f32 y;
+    } axis_right;
+
+    f32 trigger_left;
+    f32 trigger_right;
+
+    i8 pulling_trigger;
+};
+
+// Steady clock, in nanoseconds. Comparable across threads.
+inline i64 NowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline f32 MillisecondsSince(i64 time) {
+    return (NowNanoseconds() - time) / 1e6f;
+}
+
+struct InputSample {
+    GameInput input;
+    i64 time; // NowNanoseconds() when it was read
+};
+
+// Lock-free ring from the one thread that reads the devices to the one that
+// simulates. The consumer drains it right before stepping, so the steps see
+// the newest sample there is.
+struct InputRing {
+    static constexpr u32 capacity {64}; // power of two
+
+    InputSample samples[capacity];
+    std::atomic<u32> head {0}; // next write, producer only
+    std::atomic<u32> tail {0}; // next read, consumer only
+
+
+    // Producer. Drops the sample when the consumer is too far behind.
+    bool push(InputSample sample) {
+        u32 h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == capacity) return false;
+
+        samples[h & (capacity - 1)] = sample;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer
+    bool pop(InputSample *sample) {
+        u32 t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+
+        *sample = samples[t & (capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: skips to the newest sample. Leaves *sample alone if the ring
+    // was empty.
+    bool popLatest(InputSample *sample) {
+        bool any = false;
+        while (pop(sample)) {
+            any = true;
+        }
+        return any;
+    }
+};
+
+// Percentiles over the last `window` latencies
+struct LatencyStats {
+    static constexpr i32 window {512};
+
+    f32 samples[window]; // milliseconds
+    i32 count {0};        // ever added
+    f32 max_ms {0};       // ever
+
+
+    void add(f32 ms) {
+        samples[count % window] = ms;
+        count++;
+        max_ms = HMM_MAX(max_ms, ms);
+    }
+
+    // p in 0..100, over the window
+    f32 percentile(f32 p) {
+        i32 n = HMM_MIN(count, window);
+        if (n == 0) return 0;
+
+        f32 sorted[window];
+        std::copy(samples, samples + n, sorted);
+        i32 rank = HMM_MIN(n - 1, (i32)(p / 100.0f * n));
+        std::nth_element(sorted, sorted + rank, sorted + n);
+        return sorted[rank];
+    }
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "HandMadeMath.h"
+#include "defines.h"
+
+// Minimal job system: a fixed pool of worker threads pulling from one
+// fixed-size ring of jobs. Waiting threads help out instead of sleeping,
+// so it's safe to wait on jobs from inside a job.
+//
+// With zero workers every job runs inline on the pushing thread.
+
+typedef void JobFunc(void *data, i32 begin, i32 end);
+
+struct JobCounter {
+    std::atomic<i32> remaining {0};
+
+    bool done() {
+        return remaining.load(std::memory_order_acquire) == 0;
+    }
+};
+
+struct Job {
+    JobFunc *func;
+    void *data;
+    i32 begin;
+    i32 end;
+    JobCounter *counter;
+};
+
+struct JobSystem {
+    static constexpr i32 max_workers {15};
+    static constexpr i32 queue_capacity {1024};
+
+    std::thread workers[max_workers];
+    i32 worker_count {0};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    Job queue[queue_capacity];
+    i32 head {0};
+    i32 count {0};
+    bool running {false};
+
+    void start(i32 requested_workers) {
+        worker_count = HMM_MAX(0, HMM_MIN(max_workers, requested_workers));
+        running = true;
+        for (i32 i = 0; i < worker_count; i++) {
+            workers[i] = std::thread([this] { workerLoop(); });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (i32 i = 0; i < worker_count; i++) {
+            workers[i].join();
+        }
+        worker_count = 0;
+    }
+
+    // The caller accounts for the job in job.counter before pushing.
+    void push(Job job) {
+        if (worker_count) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (count < queue_capacity) {
+                queue[(head + count) % queue_capacity] = job;
+                count++;
+                lock.unlock();
+                wake.notify_one();
+                return;
+            }
+        }
+
+        // No workers, or the queue is full: just do it here
+        execute(job);
+    }
+
+    // Single job that runs in the background; poll counter->done().
+    void run(JobFunc *func, void *data, JobCounter *counter) {
+        counter->remaining.fetch_add(1, std::memory_order_relaxed);
+        push({func, data, 0, 1, counter});
+    }
+
+    // Splits [0, total) into batches and blocks until all of them ran.
+    void parallelFor(i32 total, i32 batch, JobFunc *func, void *data) {
+        if (total <= 0) return;
+        batch = HMM_MAX(1, batch);
+
+        JobCounter counter;
+        counter.remaining.store((total + batch - 1) / batch, std::memory_order_relaxed);
+        for (i32 begin = 0; begin < total; begin += batch) {
+            push({func, data, begin, HMM_MIN(total, begin + batch), &counter});
+        }
+        wait(&counter);
+    }
+
+    void wait(JobCounter *counter) {
+        while (!counter->done()) {
+            if (!runOne()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool runOne() {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!count) return false;
+            job = queue[head];
+            head = (head + 1) % queue_capacity;
+            count--;
+        }
+        execute(job);
+        return true;
+    }
+
+    void execute(Job job) {
+        job.func(job.data, job.begin, job.end);
+        job.counter->remaining.fetch_sub(1, std::memory_order_release);
+    }
+
+    void workerLoop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return count || !running; });
+                if (!count) return; // stopped and drained
+
+                job = queue[head];
+                head = (head + 1) % queue_capacity;
+                count--;
+            }
+            execute(job);
+        }
+    }
+};
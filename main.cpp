@@ -1,32 +1,81 @@
 #include <iostream>
+#include <chrono>
 #include "vendor/raylib/include/raylib.h"
 
 #include "HandMadeMath.h"
 #include "defines.h"
+#include "allocations.h"
+#include "cpu.h"
+#include "heading.h"
+#include "jobs.h"
+#include "flowfield.h"
+#include "spatialgrid.h"
+#include "render.h"
+#include "culling.h"
+#include "input.h"
+#include "profiler.h"
+#include "framestats.h"
 
 // @ROBUSTNESS: does not check for normalized t!
 f32 lerp(f32 a, f32 b, f32 t) {
     return ((1.0f - t) * a) + (t * b);
 }
 
+Vector3 LerpVector3(Vector3 a, Vector3 b, f32 t) {
+    return { lerp(a.x, b.x, t), lerp(a.y, b.y, t), lerp(a.z, b.z, t) };
+}
+
+
+
+
+// Simulation LOD: enemies further away from the player are integrated less often.
+// Tier n updates every 2^n frames, with all the dt accumulated since its last update.
+#define ENEMY_LOD_TIERS 4
+static const f32 enemy_lod_distance[ENEMY_LOD_TIERS - 1] = { 60.0f, 120.0f, 240.0f };
+
+// A far enemy's tier can be up to 2^(ENEMY_LOD_TIERS-1) frames old, so widen the
+// tier boundaries by how far it and the player can move in the meantime.
+#define ENEMY_LOD_MARGIN 8.0f
 
+// Building with ENEMY_COMPACT_MOTION keeps an enemy's direction as a heading
+// (see heading.h) and its speed in steps of ENEMY_SPEED_STEP, a byte each
+// instead of 16 bytes of floats. Enemies then move along the nearest of the
+// 256 headings, so runs play out differently from the default build.
+#define ENEMY_SPEED_STEP 0.125f
 
+typedef enum EnemyMode {
+    ENEMY_FOLLOW_FLOW = 0, // path around obstacles along the flow field
+    ENEMY_CHASE_DIRECT,    // player in sight: run straight at it
+} enemy_mode;
 
 struct Enemy {
-    u16 id;
+    u32 id;
     Vector3 position {0, 0, 0};
+    Vector3 previous_position {0, 0, 0}; // at the start of the last step, for interpolation
+#ifdef ENEMY_COMPACT_MOTION
+    u8 heading {0};
+    u8 speed_steps {(u8)(8 / ENEMY_SPEED_STEP)};
+#else
     Vector3 direction = {0, 0, 0};
     f32 speed = {8};
+#endif
     
     f32 health {100.0};
     f32 damage {3.0f};
 
     f32 width {1.1};
     f32 height {1.8};
+
+    u8  lod_tier {0};
+    f32 lod_dt {0}; // dt accumulated since the last update
+
+    EnemyMode mode {ENEMY_FOLLOW_FLOW};
+    u32 last_think_frame {0};
 };
 
 struct Player {
     Vector3 position {0, 0, 0};
+    Vector3 previous_position {0, 0, 0};
     Vector3 aim {1, 0, 0};
     f32 speed {30.5};
     bool pulling_trigger {false};
@@ -38,9 +87,11 @@ struct Player {
 
 struct Bullet {
     Vector3 position {0,0,0};
+    Vector3 previous_position {0,0,0};
     Vector3 direction{0,0,0};
     f32 speed{60};
-    u32 age{0};
+    f32 age{0};         // seconds
+    f32 lifetime{2.0f}; // seconds
     f32 damage {100.0};
 
     f32 size {0.7};
@@ -49,100 +100,138 @@ struct Bullet {
 
 struct Gun {
     Vector3 barrel_exit {0, 0, 0};
-    u32 shot_duration {8}; // frames
-    u32 current_time {0};
+    f32 shot_interval {8.0f / 60.0f}; // seconds
+    f32 current_time {0};
 
     bool trigger_down {false};
 };
 
-struct Boundary {
-    Vector3 center;
-    Vector3 dimensions;
+// Boids-style crowd steering: separation, alignment and cohesion over the
+// neighbours found through the enemy grid, added on top of the chase direction.
+struct Crowd {
+    f32 neighbour_radius  {2.5f}; // at most the enemy grid's cell size
+    f32 separation_radius {1.6f};
+
+    f32 separation_weight {1.5f};
+    f32 alignment_weight  {0.3f};
+    f32 cohesion_weight   {0.2f};
+
+    // Per enemy index, written by the steering pass
+    static constexpr i32 max_enemies {SpatialGrid::max_items};
+    bool active[max_enemies];
+    f32  steer_x[max_enemies];
+    f32  steer_z[max_enemies];
 };
 
-#define ENEMY_BUCKET_CAPACITY 16
-struct EnemyBucket {
-    u32 enemies[ENEMY_BUCKET_CAPACITY];
-    u32 count{ 0 };
+// The enemy update's per-step working set, per enemy index, in SoA so the
+// math that's the same for every enemy runs through the HMM array kernels.
+// Positions are relative to the player, which makes their length the
+// distance to it.
+struct EnemyMotion {
+    static constexpr i32 max_enemies {SpatialGrid::max_items};
+
+    alignas(16) f32 dir_x[max_enemies];
+    alignas(16) f32 dir_z[max_enemies];
+    alignas(16) f32 x[max_enemies];
+    alignas(16) f32 z[max_enemies];
+    alignas(16) f32 step[max_enemies];     // distance to move this step, 0 if it doesn't simulate
+    alignas(16) f32 distance[max_enemies]; // to the player, after moving
+#ifdef ENEMY_COMPACT_MOTION
+    alignas(16) f32 angle[max_enemies];    // of dir, for quantizing it
+    u8 heading[max_enemies];
+#endif
 };
 
-struct QuadTree {
-
-    QuadTree(Boundary boundary) {
-        this->boundary = boundary;
-    }
-
-    ~QuadTree() {
-        if (is_subdivided) {
-            delete nw;
-            delete sw;
-            delete ne;
-            delete se;
-        }
-    }
-
-    Boundary boundary;
-    EnemyBucket bucket;
+// RenderGame's scratch for the yaw of the enemies in view, in SoA for
+// HMM_ATan2FArray. Per visible index.
+struct EnemyFacing {
+    static constexpr i32 max_enemies {CullList::max_items};
 
-    QuadTree *nw, *ne, *sw, *se;
+    f32 x[max_enemies];
+    f32 z[max_enemies];
+    f32 yaw[max_enemies]; // radians
+};
 
-    bool is_subdivided {false};
+// Hard non-overlap between enemy cubes: a positional correction pass over the
+// enemy grid. The grid rows are split into a fixed number of bands that run in
+// parallel; each band only writes its own slice of `scratch`, and the slices
+// are summed in band order afterwards, so the result doesn't depend on timing
+// or on the number of threads.
+struct OverlapSolver {
+    static constexpr i32 bands {8};
+    static constexpr i32 max_enemies {SpatialGrid::max_items};
+
+    f32 min_distance {1.1f}; // Enemy::width, cubes are axis aligned
+    i32 iterations {2};      // Jacobi-style, clusters need a few to settle
+
+    // Band b handles the pairs of the items in its rows, which also touches the
+    // first row after it: slots [slot_begin, slot_end), stored from scratch_offset.
+    u32 slot_begin[bands];
+    u32 slot_end[bands];
+    u32 scratch_offset[bands];
+
+    // A slot is touched by at most two bands, so twice the items is enough
+    f32 scratch_x[2 * max_enemies];
+    f32 scratch_z[2 * max_enemies];
+};
 
-    EnemyBucket getBucket(Vector3 location) {
-        return bucket;
+// Amortized enemy decisions: every frame gets a fixed time budget for thinking,
+// spent on enemies round-robin. Movement still runs for everyone each frame,
+// with more enemies each one just thinks less often.
+//
+// The budget is per rendered frame, not per simulation step: beginFrame()
+// hands it out, and each of the frame's steps gets an even share of what the
+// steps before it left over.
+struct AIScheduler {
+    f64 budget_ms {0.5};
+    i32 cursor {0};
+    f32 sight_distance {30.0f};
+
+    f64 frame_budget_left_ms {0.5};
+    i32 frame_steps_left {1};
+
+    // Queue latency over this step's thinkers: steps since they last thought
+    i32 thought_count {0};
+    u32 latency_max {0};
+    f32 latency_avg {0};
+
+
+    // Before the steps of a frame
+    void beginFrame(i32 steps) {
+        frame_budget_left_ms = budget_ms;
+        frame_steps_left = steps;
     }
+};
 
-    void insert( Enemy *enemy ) {
-        if (!inside(enemy->position)) return;
-
-        if ( ++bucket.count >= ENEMY_BUCKET_CAPACITY  ) {
-            bucket.count = ENEMY_BUCKET_CAPACITY;
-
-            is_subdivided = true;
-            Boundary sub_boundary = {};
-
-            {
-                sub_boundary.center.x = boundary.center.x + boundary.dimensions.x/2;
-                sub_boundary.center.y = boundary.center.y - boundary.dimensions.y/2; 
-                ne = new QuadTree(sub_boundary);
-            }
-            {
-                sub_boundary.center.x = boundary.center.x - boundary.dimensions.x/2;
-                sub_boundary.center.y = boundary.center.y - boundary.dimensions.y/2; 
-                nw = new QuadTree(sub_boundary);
-            }
-            {
-                sub_boundary.center.x = boundary.center.x - boundary.dimensions.x/2;
-                sub_boundary.center.y = boundary.center.y + boundary.dimensions.y/2; 
-                se = new QuadTree(sub_boundary);
-            }
-            {
-                sub_boundary.center.x = boundary.center.x + boundary.dimensions.x/2;
-                sub_boundary.center.y = boundary.center.y + boundary.dimensions.y/2; 
-                sw = new QuadTree(sub_boundary);
-            }
-
-            ne->insert(enemy);
-            nw->insert(enemy);
-            se->insert(enemy);
-            sw->insert(enemy);
-
+// Turns real frame times into a whole number of fixed simulation steps.
+// What's left over is how far into the next step the frame is, which the
+// renderer uses to interpolate between the last two states.
+struct FixedTimestep {
+    f32 hz {120.0f};
+    i32 max_steps {8}; // per frame, past this the lost time is dropped instead of caught up
+
+    f64 accumulator {0};
+
+
+    f32 step() { return 1.0f / hz; }
+
+    // Steps to run for a frame that took frame_time seconds
+    i32 advance(f64 frame_time) {
+        accumulator += frame_time;
+        i32 steps = (i32)(accumulator * hz);
+        if (steps > max_steps) {
+            // Can't keep up (or came back from a stall): slow down rather
+            // than spiral into ever longer frames
+            steps = max_steps;
+            accumulator = 0;
+        } else {
+            accumulator -= steps / (f64)hz;
         }
-        else {
-            bucket.enemies[bucket.count] = enemy->id;
-        }
-    }
-
-    bool inside(Vector3 pos) {
-        return (pos.x >= boundary.center.x - boundary.dimensions.x || pos.x < boundary.center.x + boundary.dimensions.x ) 
-        || (pos.y >= boundary.center.y - boundary.dimensions.y || pos.y < boundary.center.y + boundary.dimensions.y);
-    }
-
-    bool subdivide() {
-        is_subdivided = true;
-        return true;
+        return steps;
     }
 
+    // 0..1, from the previous step's state to the latest one
+    f32 alpha() { return (f32)HMM_MIN(accumulator * hz, 1.0); }
 };
 
 struct Game {
@@ -150,14 +239,36 @@ struct Game {
 
     Gun gun;
 
-    static constexpr i32 max_bullets{256};
+    static constexpr i32 max_bullets{1 << 16}; // the gun alone never gets close, see RunCapacity
     Bullet bullets[max_bullets];
     i32 bullet_count {0};
     
 
-    static constexpr i32 max_enemies = 1024;
+    static constexpr i32 max_enemies = Crowd::max_enemies;
+    static constexpr i32 initial_enemies = 1024;
     Enemy enemies[ max_enemies ];
     i32 enemy_count {0};
+
+    FlowField flow_field;
+    SpatialGrid enemy_grid;
+    Crowd crowd;
+    EnemyMotion motion;
+    EnemyFacing facing;
+    OverlapSolver overlap;
+    AIScheduler ai;
+
+    Frustum frustum;
+    CullList cull;
+
+    u32 level {1};
+    StaticGeometry static_geometry; // of `level`
+
+    JobSystem *jobs {nullptr};
+
+    FixedTimestep timestep;
+    u32 frame_index {0}; // simulation steps so far
+
+    Profiler profiler; // scopes of UpdateGame, on whichever thread runs it
 };
 
 
@@ -168,33 +279,562 @@ typedef enum GameScreen {
     ENDING
 } game_screen;
 
-struct GameInput {
-    i8 button_a;
-    i8 button_b;
-    i8 button_x;
-    i8 button_y;
 
-    i8 button_start;
-    i8 button_back;
 
-    struct AxisLeft {
-        f32 x;
-        f32 y;
-    } axis_left;
 
-    struct AxisRight {
-        f32 x;
-        f32 y;
-    } axis_right;
+bool EnemySimulatesThisFrame(Game *game, Enemy *enemy) {
+    // Far enemies only simulate every 2^tier frames, staggered by id
+    u32 lod_interval = 1u << enemy->lod_tier;
+    return ((game->frame_index + enemy->id) & (lod_interval - 1)) == 0;
+}
+
+// Unit length in the xz plane
+hmm_v2 EnemyDirection(Enemy *enemy) {
+#ifdef ENEMY_COMPACT_MOTION
+    return HMM_Vec2(heading_table.x[enemy->heading], heading_table.z[enemy->heading]);
+#else
+    return HMM_Vec2(enemy->direction.x, enemy->direction.z);
+#endif
+}
+
+f32 EnemySpeed(Enemy *enemy) {
+#ifdef ENEMY_COMPACT_MOTION
+    return enemy->speed_steps * ENEMY_SPEED_STEP;
+#else
+    return enemy->speed;
+#endif
+}
 
-    f32 trigger_left;
-    f32 trigger_right;
+// Points the first count enemies along game->motion's dir_x and dir_z, which
+// needn't be normalized
+void SetEnemyDirections(Game *game, i32 count) {
+    EnemyMotion *motion = &game->motion;
+#ifdef ENEMY_COMPACT_MOTION
+    QuantizeHeadingArray(motion->dir_x, motion->dir_z, motion->angle, motion->heading, count);
+    for (i32 i = 0; i < count; i++) {
+        game->enemies[i].heading = motion->heading[i];
+    }
+#else
+    simd.normalize_vec2_array(motion->dir_x, motion->dir_z, count);
+    for (i32 i = 0; i < count; i++) {
+        game->enemies[i].direction = { motion->dir_x[i], 0, motion->dir_z[i] };
+    }
+#endif
+}
+
+#ifdef HANDMADE_MATH__USE_SSE
+static inline f32 HorizontalSum(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+#endif
+
+// Neighbour sums for one enemy, kept 4 lanes wide until all rows are done
+struct CrowdSums {
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 count;
+    __m128 dir_x, dir_z;
+    __m128 pos_x, pos_z;
+    __m128 sep_x, sep_z;
+#endif
+    f32 tail[7];
 };
 
+// Accumulates the neighbours in grid slots [begin, end) around (px, pz).
+// Excludes the enemy itself (and anything exactly on top of it) through d2 > 0.
+static void AccumulateNeighbours(SpatialGrid *grid, Crowd *crowd, u32 begin, u32 end, f32 px, f32 pz, CrowdSums *sums) {
+    f32 r2 = crowd->neighbour_radius * crowd->neighbour_radius;
+    f32 s2 = crowd->separation_radius * crowd->separation_radius;
+    u32 j = begin;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 zero = _mm_setzero_ps();
+    __m128 one  = _mm_set1_ps(1.0f);
+    __m128 wide_px = _mm_set1_ps(px);
+    __m128 wide_pz = _mm_set1_ps(pz);
+    __m128 wide_r2 = _mm_set1_ps(r2);
+    __m128 wide_s2 = _mm_set1_ps(s2);
+    __m128 min_d2  = _mm_set1_ps(1e-4f);
+
+    for (; j + 4 <= end; j += 4) {
+        __m128 ox = _mm_loadu_ps(&grid->x[j]);
+        __m128 oz = _mm_loadu_ps(&grid->z[j]);
+        __m128 dx = _mm_sub_ps(wide_px, ox);
+        __m128 dz = _mm_sub_ps(wide_pz, oz);
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+
+        __m128 in_range  = _mm_and_ps(_mm_cmplt_ps(d2, wide_r2), _mm_cmpgt_ps(d2, zero));
+        __m128 too_close = _mm_and_ps(in_range, _mm_cmplt_ps(d2, wide_s2));
+
+        sums->count = _mm_add_ps(sums->count, _mm_and_ps(in_range, one));
+        sums->dir_x = _mm_add_ps(sums->dir_x, _mm_and_ps(in_range, _mm_loadu_ps(&grid->vx[j])));
+        sums->dir_z = _mm_add_ps(sums->dir_z, _mm_and_ps(in_range, _mm_loadu_ps(&grid->vz[j])));
+        sums->pos_x = _mm_add_ps(sums->pos_x, _mm_and_ps(in_range, ox));
+        sums->pos_z = _mm_add_ps(sums->pos_z, _mm_and_ps(in_range, oz));
+
+        // Push away weighted by 1/d (dx/d2 is the unit offset over d). The
+        // approximate reciprocal is plenty for steering.
+        __m128 inv_d2 = _mm_rcp_ps(_mm_max_ps(d2, min_d2));
+        sums->sep_x = _mm_add_ps(sums->sep_x, _mm_and_ps(too_close, _mm_mul_ps(dx, inv_d2)));
+        sums->sep_z = _mm_add_ps(sums->sep_z, _mm_and_ps(too_close, _mm_mul_ps(dz, inv_d2)));
+    }
+#endif
+
+    // Tail (or everything, without SSE)
+    for (; j < end; j++) {
+        f32 dx = px - grid->x[j];
+        f32 dz = pz - grid->z[j];
+        f32 d2 = dx * dx + dz * dz;
+        if (d2 >= r2 || d2 <= 0) continue;
+
+        sums->tail[0] += 1.0f;
+        sums->tail[1] += grid->vx[j];
+        sums->tail[2] += grid->vz[j];
+        sums->tail[3] += grid->x[j];
+        sums->tail[4] += grid->z[j];
+        if (d2 < s2) {
+            f32 inv_d2 = 1.0f / HMM_MAX(d2, 1e-4f);
+            sums->tail[5] += dx * inv_d2;
+            sums->tail[6] += dz * inv_d2;
+        }
+    }
+}
+
+// Job over grid slots, so neighbouring enemies are processed together
+static void CrowdSteeringJob(void *data, i32 begin, i32 end) {
+    Game *game = (Game *)data;
+    SpatialGrid *grid = &game->enemy_grid;
+    Crowd *crowd = &game->crowd;
+
+    for (i32 s = begin; s < end; s++) {
+        u32 i = grid->index[s];
+        if (!crowd->active[i]) continue;
+
+        f32 px = grid->x[s];
+        f32 pz = grid->z[s];
+        i32 cx = grid->cellX(px);
+        i32 cz = grid->cellZ(pz);
+
+        CrowdSums sums = {};
+        for (i32 row = HMM_MAX(0, cz - 1); row <= HMM_MIN(SpatialGrid::height - 1, cz + 1); row++) {
+            u32 range_begin, range_end;
+            grid->rowRange(cx - 1, cx + 1, row, &range_begin, &range_end);
+            AccumulateNeighbours(grid, crowd, range_begin, range_end, px, pz, &sums);
+        }
+
+        f32 count = sums.tail[0];
+        f32 dir_x = sums.tail[1];
+        f32 dir_z = sums.tail[2];
+        f32 pos_x = sums.tail[3];
+        f32 pos_z = sums.tail[4];
+        f32 sep_x = sums.tail[5];
+        f32 sep_z = sums.tail[6];
+#ifdef HANDMADE_MATH__USE_SSE
+        count += HorizontalSum(sums.count);
+        dir_x += HorizontalSum(sums.dir_x);
+        dir_z += HorizontalSum(sums.dir_z);
+        pos_x += HorizontalSum(sums.pos_x);
+        pos_z += HorizontalSum(sums.pos_z);
+        sep_x += HorizontalSum(sums.sep_x);
+        sep_z += HorizontalSum(sums.sep_z);
+#endif
+
+        f32 steer_x = sep_x * crowd->separation_weight;
+        f32 steer_z = sep_z * crowd->separation_weight;
+        if (count > 0) {
+            f32 inv_count = 1.0f / count;
+            steer_x += dir_x * inv_count * crowd->alignment_weight;
+            steer_z += dir_z * inv_count * crowd->alignment_weight;
+
+            f32 inv_radius = 1.0f / crowd->neighbour_radius;
+            steer_x += (pos_x * inv_count - px) * inv_radius * crowd->cohesion_weight;
+            steer_z += (pos_z * inv_count - pz) * inv_radius * crowd->cohesion_weight;
+        }
+
+        crowd->steer_x[i] = steer_x;
+        crowd->steer_z[i] = steer_z;
+    }
+}
+
+// Bins every enemy where it is now
+void BuildEnemyGrid(Game *game) {
+    SpatialGrid *grid = &game->enemy_grid;
+
+    grid->clear(game->enemy_count);
+    for (i32 i = 0; i < game->enemy_count; i++) {
+        Enemy *enemy = &game->enemies[i];
+        hmm_v2 direction = EnemyDirection(enemy);
+        grid->add(i, enemy->position.x, enemy->position.z, direction.X, direction.Y);
+    }
+    grid->sort();
+}
+
+void UpdateCrowd(Game *game) {
+    SpatialGrid *grid = &game->enemy_grid;
+    Crowd *crowd = &game->crowd;
+
+    BuildEnemyGrid(game);
+    for (i32 i = 0; i < game->enemy_count; i++) {
+        crowd->active[i] = EnemySimulatesThisFrame(game, &game->enemies[i]);
+    }
+
+    game->jobs->parallelFor(grid->item_count, 1024, CrowdSteeringJob, game);
+}
+
+static void BandRows(i32 band, i32 *row_begin, i32 *row_end) {
+    *row_begin = band * SpatialGrid::height / OverlapSolver::bands;
+    *row_end = (band + 1) * SpatialGrid::height / OverlapSolver::bands;
+}
+
+// Tests slot i against the slots [begin, end) and pushes overlapping pairs
+// apart along the axis of least penetration, half each.
+static void ResolvePairs(SpatialGrid *grid, OverlapSolver *solver, f32 *out_x, f32 *out_z, u32 i, u32 begin, u32 end) {
+    f32 xi = grid->x[i];
+    f32 zi = grid->z[i];
+    f32 w = solver->min_distance;
+    f32 push_x = 0;
+    f32 push_z = 0;
+    u32 j = begin;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 zero = _mm_setzero_ps();
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 sign_bit = _mm_set1_ps(-0.0f);
+    __m128 wide_w  = _mm_set1_ps(w);
+    __m128 wide_xi = _mm_set1_ps(xi);
+    __m128 wide_zi = _mm_set1_ps(zi);
+    __m128 wide_push_x = zero;
+    __m128 wide_push_z = zero;
+
+    for (; j + 4 <= end; j += 4) {
+        __m128 dx = _mm_sub_ps(wide_xi, _mm_loadu_ps(&grid->x[j]));
+        __m128 dz = _mm_sub_ps(wide_zi, _mm_loadu_ps(&grid->z[j]));
+
+        // Penetration depth per axis
+        __m128 pen_x = _mm_sub_ps(wide_w, _mm_andnot_ps(sign_bit, dx));
+        __m128 pen_z = _mm_sub_ps(wide_w, _mm_andnot_ps(sign_bit, dz));
+        __m128 overlap = _mm_and_ps(_mm_cmpgt_ps(pen_x, zero), _mm_cmpgt_ps(pen_z, zero));
+        if (!_mm_movemask_ps(overlap)) continue;
+
+        // Push i away from j with the sign of d (positive when d is zero)
+        __m128 along_x = _mm_cmplt_ps(pen_x, pen_z);
+        __m128 amount_x = _mm_and_ps(_mm_and_ps(overlap, along_x), _mm_mul_ps(pen_x, half));
+        __m128 amount_z = _mm_and_ps(_mm_andnot_ps(along_x, overlap), _mm_mul_ps(pen_z, half));
+        amount_x = _mm_or_ps(amount_x, _mm_and_ps(sign_bit, dx));
+        amount_z = _mm_or_ps(amount_z, _mm_and_ps(sign_bit, dz));
+
+        wide_push_x = _mm_add_ps(wide_push_x, amount_x);
+        wide_push_z = _mm_add_ps(wide_push_z, amount_z);
+        _mm_storeu_ps(&out_x[j], _mm_sub_ps(_mm_loadu_ps(&out_x[j]), amount_x));
+        _mm_storeu_ps(&out_z[j], _mm_sub_ps(_mm_loadu_ps(&out_z[j]), amount_z));
+    }
+
+    push_x += HorizontalSum(wide_push_x);
+    push_z += HorizontalSum(wide_push_z);
+#endif
+
+    // Tail (or everything, without SSE)
+    for (; j < end; j++) {
+        f32 dx = xi - grid->x[j];
+        f32 dz = zi - grid->z[j];
+        f32 pen_x = w - fabsf(dx);
+        f32 pen_z = w - fabsf(dz);
+        if (pen_x <= 0 || pen_z <= 0) continue;
+
+        f32 amount_x = 0;
+        f32 amount_z = 0;
+        if (pen_x < pen_z) amount_x = copysignf(pen_x * 0.5f, dx);
+        else               amount_z = copysignf(pen_z * 0.5f, dz);
+
+        push_x += amount_x;
+        push_z += amount_z;
+        out_x[j] -= amount_x;
+        out_z[j] -= amount_z;
+    }
 
+    out_x[i] += push_x;
+    out_z[i] += push_z;
+}
+
+#ifdef CPU_DISPATCH
+CPU_TARGET_AVX2 static inline f32 HorizontalSum256(__m256 v) {
+    return HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+// ResolvePairs 8 wide, the rest of the range goes to ResolvePairs
+CPU_TARGET_AVX2 static void ResolvePairsAVX2(SpatialGrid *grid, OverlapSolver *solver, f32 *out_x, f32 *out_z, u32 i, u32 begin, u32 end) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 half = _mm256_set1_ps(0.5f);
+    __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    __m256 wide_w  = _mm256_set1_ps(solver->min_distance);
+    __m256 wide_xi = _mm256_set1_ps(grid->x[i]);
+    __m256 wide_zi = _mm256_set1_ps(grid->z[i]);
+    __m256 wide_push_x = zero;
+    __m256 wide_push_z = zero;
+
+    u32 j = begin;
+    for (; j + 8 <= end; j += 8) {
+        __m256 dx = _mm256_sub_ps(wide_xi, _mm256_loadu_ps(&grid->x[j]));
+        __m256 dz = _mm256_sub_ps(wide_zi, _mm256_loadu_ps(&grid->z[j]));
+
+        __m256 pen_x = _mm256_sub_ps(wide_w, _mm256_andnot_ps(sign_bit, dx));
+        __m256 pen_z = _mm256_sub_ps(wide_w, _mm256_andnot_ps(sign_bit, dz));
+        __m256 overlap = _mm256_and_ps(_mm256_cmp_ps(pen_x, zero, _CMP_GT_OQ), _mm256_cmp_ps(pen_z, zero, _CMP_GT_OQ));
+        if (!_mm256_movemask_ps(overlap)) continue;
+
+        __m256 along_x = _mm256_cmp_ps(pen_x, pen_z, _CMP_LT_OQ);
+        __m256 amount_x = _mm256_and_ps(_mm256_and_ps(overlap, along_x), _mm256_mul_ps(pen_x, half));
+        __m256 amount_z = _mm256_and_ps(_mm256_andnot_ps(along_x, overlap), _mm256_mul_ps(pen_z, half));
+        amount_x = _mm256_or_ps(amount_x, _mm256_and_ps(sign_bit, dx));
+        amount_z = _mm256_or_ps(amount_z, _mm256_and_ps(sign_bit, dz));
+
+        wide_push_x = _mm256_add_ps(wide_push_x, amount_x);
+        wide_push_z = _mm256_add_ps(wide_push_z, amount_z);
+        _mm256_storeu_ps(&out_x[j], _mm256_sub_ps(_mm256_loadu_ps(&out_x[j]), amount_x));
+        _mm256_storeu_ps(&out_z[j], _mm256_sub_ps(_mm256_loadu_ps(&out_z[j]), amount_z));
+    }
+
+    out_x[i] += HorizontalSum256(wide_push_x);
+    out_z[i] += HorizontalSum256(wide_push_z);
+    ResolvePairs(grid, solver, out_x, out_z, i, j, end);
+}
+
+// Zero-masked shuffles and extract: GCC 12's unmasked ones (and _mm512_reduce_add_ps)
+// trip -Wuninitialized on their undefined pass-through operand
+CPU_TARGET_AVX512 static inline f32 HorizontalSum512(__m512 v) {
+    v = _mm512_add_ps(v, _mm512_maskz_shuffle_f32x4(0xFFFF, v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_add_ps(v, _mm512_maskz_shuffle_f32x4(0xFFFF, v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return HorizontalSum(_mm512_maskz_extractf32x4_ps(0xF, v, 0));
+}
+
+// ResolvePairs 16 wide. Neighbour ranges are short, so usually this is one
+// masked iteration with no tail at all.
+CPU_TARGET_AVX512 static void ResolvePairsAVX512(SpatialGrid *grid, OverlapSolver *solver, f32 *out_x, f32 *out_z, u32 i, u32 begin, u32 end) {
+    __m512 zero = _mm512_setzero_ps();
+    __m512 half = _mm512_set1_ps(0.5f);
+    __m512 wide_w  = _mm512_set1_ps(solver->min_distance);
+    __m512 wide_xi = _mm512_set1_ps(grid->x[i]);
+    __m512 wide_zi = _mm512_set1_ps(grid->z[i]);
+    __m512i sign_bit = _mm512_set1_epi32((i32)0x80000000);
+    __m512 wide_push_x = zero;
+    __m512 wide_push_z = zero;
+
+    for (u32 j = begin; j < end; j += 16) {
+        __mmask16 lanes = LaneMask16((i32)(end - j));
+        __m512 dx = _mm512_sub_ps(wide_xi, _mm512_maskz_loadu_ps(lanes, &grid->x[j]));
+        __m512 dz = _mm512_sub_ps(wide_zi, _mm512_maskz_loadu_ps(lanes, &grid->z[j]));
+
+        __m512 pen_x = _mm512_sub_ps(wide_w, _mm512_abs_ps(dx));
+        __m512 pen_z = _mm512_sub_ps(wide_w, _mm512_abs_ps(dz));
+        __mmask16 overlap = _mm512_mask_cmp_ps_mask(lanes, pen_x, zero, _CMP_GT_OQ);
+        overlap = _mm512_mask_cmp_ps_mask(overlap, pen_z, zero, _CMP_GT_OQ);
+        if (!overlap) continue;
+
+        __mmask16 along_x = _mm512_cmp_ps_mask(pen_x, pen_z, _CMP_LT_OQ);
+        __m512 amount_x = _mm512_maskz_mul_ps(overlap & along_x, pen_x, half);
+        __m512 amount_z = _mm512_maskz_mul_ps(overlap & ~along_x, pen_z, half);
+        amount_x = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(amount_x), _mm512_and_si512(sign_bit, _mm512_castps_si512(dx))));
+        amount_z = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(amount_z), _mm512_and_si512(sign_bit, _mm512_castps_si512(dz))));
+
+        wide_push_x = _mm512_add_ps(wide_push_x, amount_x);
+        wide_push_z = _mm512_add_ps(wide_push_z, amount_z);
+        _mm512_mask_storeu_ps(&out_x[j], overlap, _mm512_sub_ps(_mm512_maskz_loadu_ps(overlap, &out_x[j]), amount_x));
+        _mm512_mask_storeu_ps(&out_z[j], overlap, _mm512_sub_ps(_mm512_maskz_loadu_ps(overlap, &out_z[j]), amount_z));
+    }
+
+    out_x[i] += HorizontalSum512(wide_push_x);
+    out_z[i] += HorizontalSum512(wide_push_z);
+}
+#endif
+
+static void OverlapBandJob(void *data, i32 begin, i32 end) {
+    Game *game = (Game *)data;
+    SpatialGrid *grid = &game->enemy_grid;
+    OverlapSolver *solver = &game->overlap;
+    const i32 width = SpatialGrid::width;
+
+    for (i32 band = begin; band < end; band++) {
+        // Offset so that out_x[slot] lands in this band's slice of scratch
+        f32 *out_x = solver->scratch_x + solver->scratch_offset[band] - solver->slot_begin[band];
+        f32 *out_z = solver->scratch_z + solver->scratch_offset[band] - solver->slot_begin[band];
+        for (u32 slot = solver->slot_begin[band]; slot < solver->slot_end[band]; slot++) {
+            out_x[slot] = 0;
+            out_z[slot] = 0;
+        }
 
-void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 window_width, f32 window_height) {
+        i32 row_begin, row_end;
+        BandRows(band, &row_begin, &row_end);
+
+        // Half neighbourhood, so every pair is tested once: the rest of our
+        // own cell plus the cell to the right, then three cells of the next row.
+        for (i32 cz = row_begin; cz < row_end; cz++) {
+            for (i32 cx = 0; cx < width; cx++) {
+                u32 cell_end = grid->cell_start[cz * width + cx + 1];
+                for (u32 i = grid->cell_start[cz * width + cx]; i < cell_end; i++) {
+                    u32 range_begin, range_end;
+                    grid->rowRange(cx, cx + 1, cz, &range_begin, &range_end);
+                    simd.resolve_pairs(grid, solver, out_x, out_z, i, i + 1, range_end);
+
+                    if (cz + 1 < SpatialGrid::height) {
+                        grid->rowRange(cx - 1, cx + 1, cz + 1, &range_begin, &range_end);
+                        simd.resolve_pairs(grid, solver, out_x, out_z, i, range_begin, range_end);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Sums the band slices for the band's own slots, in band order, and applies them
+static void OverlapApplyJob(void *data, i32 begin, i32 end) {
+    Game *game = (Game *)data;
+    SpatialGrid *grid = &game->enemy_grid;
+    OverlapSolver *solver = &game->overlap;
+
+    for (i32 band = begin; band < end; band++) {
+        i32 row_begin, row_end;
+        BandRows(band, &row_begin, &row_end);
+        u32 own_begin = grid->cell_start[row_begin * SpatialGrid::width];
+        u32 own_end   = grid->cell_start[row_end * SpatialGrid::width];
+
+        for (u32 slot = own_begin; slot < own_end; slot++) {
+            f32 x = 0;
+            f32 z = 0;
+            if (band > 0 && slot < solver->slot_end[band - 1]) {
+                u32 at = solver->scratch_offset[band - 1] + slot - solver->slot_begin[band - 1];
+                x += solver->scratch_x[at];
+                z += solver->scratch_z[at];
+            }
+            u32 at = solver->scratch_offset[band] + slot - solver->slot_begin[band];
+            x += solver->scratch_x[at];
+            z += solver->scratch_z[at];
+
+            Enemy *enemy = &game->enemies[grid->index[slot]];
+            enemy->position.x += x;
+            enemy->position.z += z;
+        }
+    }
+}
+
+// Runs after integration, on the grid built this frame. Enemies moved since,
+// so their grid positions are refreshed first, but cells stay as they were:
+// two enemies whose cells aren't neighbours were a cell apart at the build, so
+// they can only overlap now if, on one axis, they closed in by more than a cell
+// minus min_distance. When anyone moved more than half that on an axis (a far
+// LOD tier catching up on several steps at a low --sim-hz, say), the grid is
+// rebuilt from where everyone is now instead.
+void ResolveEnemyOverlaps(Game *game) {
+    SpatialGrid *grid = &game->enemy_grid;
+    OverlapSolver *solver = &game->overlap;
+    const i32 width = SpatialGrid::width;
+    const f32 drift = (grid->cell_size - solver->min_distance) * 0.5f;
+
+    for (i32 iteration = 0; iteration < solver->iterations; iteration++) {
+        // stage_x/z still hold where each enemy was binned
+        bool drifted = false;
+        for (i32 slot = 0; slot < grid->item_count; slot++) {
+            u32 i = grid->index[slot];
+            Enemy *enemy = &game->enemies[i];
+            grid->x[slot] = enemy->position.x;
+            grid->z[slot] = enemy->position.z;
+            drifted |= fabsf(enemy->position.x - grid->stage_x[i]) > drift || fabsf(enemy->position.z - grid->stage_z[i]) > drift;
+        }
+        if (drifted) {
+            BuildEnemyGrid(game);
+        }
+
+        u32 offset = 0;
+        for (i32 band = 0; band < OverlapSolver::bands; band++) {
+            i32 row_begin, row_end;
+            BandRows(band, &row_begin, &row_end);
+            i32 touched_end = HMM_MIN(row_end + 1, SpatialGrid::height);
+
+            solver->slot_begin[band] = grid->cell_start[row_begin * width];
+            solver->slot_end[band]   = grid->cell_start[touched_end * width];
+            solver->scratch_offset[band] = offset;
+            offset += solver->slot_end[band] - solver->slot_begin[band];
+        }
+
+        game->jobs->parallelFor(OverlapSolver::bands, 1, OverlapBandJob, game);
+        game->jobs->parallelFor(OverlapSolver::bands, 1, OverlapApplyJob, game);
+    }
+}
+
+// Static world geometry, only rebuilt when the level changes
+void BuildStaticGeometry(Game *game) {
+    StaticGeometry *geometry = &game->static_geometry;
+    geometry->clear();
+    geometry->addGrid(300, 10, 0.1f);
+    geometry->bake(game->level);
+}
+
+// The (potentially expensive) decision an enemy makes when it gets its turn.
+// Nothing sets FlowField::blocked yet, so for now the line of sight test
+// always passes and this comes down to the distance check; it stands in for
+// the real decision until levels have obstacles.
+void EnemyThink(Game *game, Enemy *enemy) {
     Player *player = &game->player;
+    AIScheduler *ai = &game->ai;
+
+    f32 x = player->position.x - enemy->position.x;
+    f32 z = player->position.z - enemy->position.z;
+    bool in_range = x * x + z * z < ai->sight_distance * ai->sight_distance;
+
+    if (in_range && game->flow_field.lineOfSight(enemy->position, player->position)) {
+        enemy->mode = ENEMY_CHASE_DIRECT;
+    }
+    else {
+        enemy->mode = ENEMY_FOLLOW_FLOW;
+    }
+}
+
+void RunAIScheduler(Game *game) {
+    AIScheduler *ai = &game->ai;
+    ai->thought_count = 0;
+    ai->latency_max = 0;
+    ai->latency_avg = 0;
+
+    f64 step_budget_ms = ai->frame_budget_left_ms / HMM_MAX(ai->frame_steps_left, 1);
+    ai->frame_steps_left--;
+
+    i32 enemy_count = game->enemy_count;
+    if (!enemy_count) return;
+
+    auto start = std::chrono::steady_clock::now();
+    u64 latency_sum = 0;
+
+    // Nobody thinks twice in one frame. Reading the clock isn't free either,
+    // so only check the budget every few enemies.
+    while (ai->thought_count < enemy_count) {
+        if ((ai->thought_count & 7) == 0 && ai->thought_count) {
+            std::chrono::duration<f64, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= step_budget_ms) break;
+        }
+
+        if (ai->cursor >= enemy_count) ai->cursor = 0;
+        Enemy *enemy = &game->enemies[ai->cursor++];
+
+        u32 latency = game->frame_index - enemy->last_think_frame;
+        latency_sum += latency;
+        ai->latency_max = HMM_MAX(ai->latency_max, latency);
+
+        EnemyThink(game, enemy);
+        enemy->last_think_frame = game->frame_index;
+        ai->thought_count++;
+    }
+
+    ai->latency_avg = (f32)latency_sum / (f32)ai->thought_count;
+
+    std::chrono::duration<f64, std::milli> spent = std::chrono::steady_clock::now() - start;
+    ai->frame_budget_left_ms = HMM_MAX(ai->frame_budget_left_ms - spent.count(), 0.0);
+}
+
+// One fixed simulation step of dt seconds
+void UpdateGame(Game *game, GameInput input, f32 dt) {
+    Player *player = &game->player;
+    player->previous_position = player->position;
 
     player->position.y = player->size / 2.f;
     player->position.x += input.axis_left.x * player->speed * dt;
@@ -202,9 +842,6 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
 
     game->gun.barrel_exit = player->position;
 
-    camera->target   = player->position;
-    camera->position = { player->position.x, player->position.y + 75, player->position.z + 30 };
-
     hmm_v3 aim_axis = { input.axis_right.x, 0, input.axis_right.y };
     f32 l = HMM_LengthVec3(aim_axis);
     if (l > 0.06) {
@@ -213,6 +850,8 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
     }
     player->aim = {aim_axis.X, aim_axis.Y, aim_axis.Z};
 
+    player->pulling_trigger = input.pulling_trigger;
+
     // Bullets logic
     i32 max_bullets = game->max_bullets;
     bool want_to_fire_gun  = player->pulling_trigger || input.trigger_right > 0.7;
@@ -223,15 +862,16 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
             gun->current_time = 0;
         }
         else {
-            gun->current_time++;
-            if (gun->current_time > gun->shot_duration) {
-                gun->current_time = 0;
+            gun->current_time += dt;
+            if (gun->current_time > gun->shot_interval) {
+                gun->current_time -= gun->shot_interval;
                 if (game->bullet_count < max_bullets) {
                     // Add bullet
 
                     Bullet *bullet = &game->bullets[game->bullet_count];
                     bullet->direction = game->player.aim;
                     bullet->position = game->gun.barrel_exit;
+                    bullet->previous_position = bullet->position;
                     game->bullet_count = game->bullet_count + 1;     
                 }
             }
@@ -250,47 +890,56 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
 
 
 
-    // CREATE ENEMY QuadTree 
-    Boundary boundary;
-    boundary.center =  {player->position.x, player->position.y, 0};
-    boundary.dimensions = {1000.0, 1000.0, 0.0};
-    QuadTree *qt = new QuadTree(boundary);
-    {
-        for (u32 i = 0; i < (u32)game->enemy_count; i++) {
-            Enemy *enemy = &game->enemies[i];
-            qt->insert(enemy);
-        }
-    }
-
+    Profiler *profiler = &game->profiler;
+    ProfileScope scope;
 
-    
+    // One flow field towards the player, shared by all enemies. Only rebuilt
+    // (in the background) when the player changes cell.
+    scope.begin(profiler, "flow field");
+    game->flow_field.update(player->position, game->jobs);
+    scope.end();
 
-    // Draw the "GAME screen"
-    {
-        // Background
-        DrawRectangle(0,0, window_width, window_height, DARKGRAY);
+    scope.begin(profiler, "ai");
+    RunAIScheduler(game);
+    scope.end();
 
-        BeginMode3D(*camera);
+    // Crowd steering, through the enemy grid
+    scope.begin(profiler, "crowd steering");
+    UpdateCrowd(game);
+    scope.end();
 
 
-        
-        // Update, draw and possibly remove bullets
+    // Update the "GAME screen"
+    {
+        // Update and possibly remove bullets
         {
+            scope.begin(profiler, "bullet collision");
             if (game->bullet_count) {
                 
                 for (i32 i = 0; i < game->bullet_count; i++) {
                     Bullet *bullet = &game->bullets[i];
+                    bullet->previous_position = bullet->position;
                     bullet->position.x = bullet->position.x + (bullet->speed * bullet->direction.x) * dt;
                     bullet->position.z = bullet->position.z + (bullet->speed * bullet->direction.z) * dt;
-                    bullet->age++;
+                    bullet->age += dt;
 
                     Vector3 pos = bullet->position;
                     bool remove = false;
 
+                    // Enemies in LOD tiers that start beyond this bullet can't be hit
+                    u8 max_tier = 0;
+                    {
+                        f32 reach = getDistanceIgnoreY(pos, player->position) + bullet->size + ENEMY_LOD_MARGIN;
+                        while (max_tier < ENEMY_LOD_TIERS - 1 && enemy_lod_distance[max_tier] <= reach) {
+                            max_tier++;
+                        }
+                    }
 
                     // Check all enemies for hit!
                     for (i32 i = 0; i < game->enemy_count; i++) {
                         Enemy *enemy = &game->enemies[i];
+                        if (enemy->lod_tier > max_tier) continue;
+
                         Vector3 enemy_pos = enemy->position;
 
                         
@@ -301,11 +950,8 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
                         }
                     }
                     
-                    DrawSphere(bullet->position, bullet->size, YELLOW);
 
-
-
-                    if (bullet->age >= 120) { // frames 
+                    if (bullet->age >= bullet->lifetime) {
                         remove = true;
                     }
 
@@ -321,36 +967,105 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
                     }
                 }
             }
+            scope.end();
+        }
+        // Update enemies
+        {
+            scope.begin(profiler, "enemy update");
+            EnemyMotion *motion = &game->motion;
+            i32 enemy_count = game->enemy_count;
+
+            // Steer along the flow field, or straight at the player when in
+            // sight, sharing a cell with it or outside the field. Normalized
+            // (or quantized) below, all at once.
+            for (i32 i = 0; i < enemy_count; i++) {
+                Enemy *enemy = &game->enemies[i];
+                enemy->previous_position = enemy->position;
+                motion->x[i] = enemy->position.x - player->position.x;
+                motion->z[i] = enemy->position.z - player->position.z;
+
+                enemy->lod_dt += dt;
+                if (!EnemySimulatesThisFrame(game, enemy)) {
+                    hmm_v2 direction = EnemyDirection(enemy);
+                    motion->dir_x[i] = direction.X;
+                    motion->dir_z[i] = direction.Y;
+                    motion->step[i] = 0;
+                    continue;
+                }
+
+                motion->step[i] = EnemySpeed(enemy) * enemy->lod_dt;
+                enemy->lod_dt = 0;
+
+                hmm_v2 flow = {0, 0};
+                if (enemy->mode == ENEMY_FOLLOW_FLOW) {
+                    flow = game->flow_field.sample(enemy->position);
+                }
+                if (flow.X == 0 && flow.Y == 0) {
+                    flow = HMM_NormalizeVec2(HMM_Vec2(-motion->x[i], -motion->z[i]));
+                }
+
+                hmm_v2 steered = HMM_Vec2(flow.X + game->crowd.steer_x[i], flow.Y + game->crowd.steer_z[i]);
+                if (HMM_LengthSquaredVec2(steered) > 1e-6f) {
+                    flow = steered;
+                }
+                motion->dir_x[i] = flow.X;
+                motion->dir_z[i] = flow.Y;
+            }
+
+#ifdef ENEMY_COMPACT_MOTION
+            // Only the angle matters: move along the nearest heading instead
+            QuantizeHeadingArray(motion->dir_x, motion->dir_z, motion->angle, motion->heading, enemy_count);
+            for (i32 i = 0; i < enemy_count; i++) {
+                motion->dir_x[i] = heading_table.x[motion->heading[i]];
+                motion->dir_z[i] = heading_table.z[motion->heading[i]];
+            }
+#else
+            simd.normalize_vec2_array(motion->dir_x, motion->dir_z, enemy_count);
+#endif
+            simd.add_scaled_vec2_array(motion->x, motion->z, motion->dir_x, motion->dir_z, motion->step, enemy_count);
+            simd.length_vec2_array(motion->x, motion->z, motion->distance, enemy_count);
+
+            for (i32 i = 0; i < enemy_count; i++) {
+                Enemy *enemy = &game->enemies[i];
+                if (!EnemySimulatesThisFrame(game, enemy)) continue;
+
+#ifdef ENEMY_COMPACT_MOTION
+                enemy->heading = motion->heading[i];
+#else
+                enemy->direction = { motion->dir_x[i], 0.0, motion->dir_z[i] };
+#endif
+                enemy->position.x = player->position.x + motion->x[i];
+                enemy->position.z = player->position.z + motion->z[i];
+                f32 dist = motion->distance[i];
+
+                // Check player contact
+                if (dist < player->size/2 + enemy->width/2) {
+                    player->health -= enemy->damage;
+                }
+
+                u8 tier = 0;
+                while (tier < ENEMY_LOD_TIERS - 1 && dist >= enemy_lod_distance[tier]) {
+                    tier++;
+                }
+                enemy->lod_tier = tier;
+            }
+            scope.end();
         }
-        // Update, draw and possibly remove enemies
+
+        // Push overlapping enemies apart. Needs the enemy indices the grid was built with,
+        // so this goes before anything gets removed.
+        scope.begin(profiler, "enemy overlaps");
+        ResolveEnemyOverlaps(game);
+        scope.end();
+
+        // Remove dead enemies
         {
+            scope.begin(profiler, "enemy removal");
             if (game->enemy_count) {
                 
                 for (i32 i = game->enemy_count - 1; i >= 0; i--) {
-                    bool remove = false;
                     Enemy *enemy = &game->enemies[i];
-
-                    enemy->position.x += (enemy->speed * enemy->direction.x) * dt;
-                    enemy->position.z += (enemy->speed * enemy->direction.z) * dt;
-
-                    // Check player contact
-                    {
-                        Vector3 player_pos = player->position;
-                        Vector3 enemy_pos = enemy->position;
-                        f32 dist = getDistanceIgnoreY(player_pos, enemy_pos);
-                        if (dist < player->size/2 + enemy->width/2) {
-                            player->health -= enemy->damage;
-                            enemy->direction.x *= -1.0f;
-                            enemy->direction.y *= -1.0f;
-                        }
-                    }
-                   
-                    if (enemy->health > 0) {
-                        DrawCube(enemy->position, enemy->width, enemy->height, enemy->width, RED);
-                    }
-                    else {
-                        remove = true;
-                    }
+                    bool remove = enemy->health <= 0;
 
                     if (remove) {
                         i32 last_index = game->enemy_count - 1;
@@ -363,34 +1078,861 @@ void UpdateAndRender(Game *game, Camera *camera, GameInput input, f32 dt, f32 wi
                     }
                 }
             }
+            scope.end();
+        }
+    }
+
+    game->frame_index++;
+}
+
+// Render commands for the state `alpha` (0..1) of the way from the previous
+// simulation step to the latest one
+void RenderGame(Game *game, Camera *camera, f32 alpha, f32 window_width, f32 window_height, RenderCommandBuffer *commands) {
+    Player *player = &game->player;
+    Vector3 player_pos = LerpVector3(player->previous_position, player->position, alpha);
+
+    camera->target   = player_pos;
+    camera->position = { player_pos.x, player_pos.y + 75, player_pos.z + 30 };
+
+    // Draw the "GAME screen"
+    {
+        commands->begin(*camera);
+        commands->background = DARKGRAY;
+
+        if (game->static_geometry.level != game->level) {
+            BuildStaticGeometry(game);
+        }
+
+        // Only what's in view gets submitted. The cull lists hold the
+        // interpolated positions, which is also what gets drawn.
+        game->frustum.fromCamera(*camera, window_width / window_height);
+        CullList *cull = &game->cull;
+
+        // Draw the bullets in view
+        {
+            cull->clear();
+            for (i32 i = 0; i < game->bullet_count; i++) {
+                Bullet *bullet = &game->bullets[i];
+                cull->add(LerpVector3(bullet->previous_position, bullet->position, alpha));
+            }
+            game->frustum.cullSpheres(cull, Bullet().size);
+            commands->culled += cull->count - cull->visible_count;
+
+            for (i32 v = 0; v < cull->visible_count; v++) {
+                u32 i = cull->visible[v];
+                Bullet *bullet = &game->bullets[i];
+                commands->push(MESH_SPHERE, {cull->x[i], cull->y[i], cull->z[i]}, {bullet->size, bullet->size, bullet->size}, YELLOW);
+            }
+        }
+
+        // Draw the enemies in view
+        {
+            cull->clear();
+            for (i32 i = 0; i < game->enemy_count; i++) {
+                Enemy *enemy = &game->enemies[i];
+                cull->add(LerpVector3(enemy->previous_position, enemy->position, alpha));
+            }
+            // The cubes turn to face where they're going, so in x and z they
+            // reach out to the corner of their footprint at any yaw
+            Enemy enemy_size = {};
+            f32 reach = enemy_size.width * 0.5f * HMM_SquareRootF(2);
+            game->frustum.cullBoxes(cull, HMM_Vec3(reach, enemy_size.height / 2, reach));
+            commands->culled += cull->count - cull->visible_count;
+
+            // Facing where they're going
+            EnemyFacing *facing = &game->facing;
+#ifdef ENEMY_COMPACT_MOTION
+            // The heading is already an angle, just from +x instead of +z
+            for (i32 v = 0; v < cull->visible_count; v++) {
+                facing->yaw[v] = HMM_PI32 / 2.0f - game->enemies[cull->visible[v]].heading * heading_radians;
+            }
+#else
+            for (i32 v = 0; v < cull->visible_count; v++) {
+                Enemy *enemy = &game->enemies[cull->visible[v]];
+                facing->x[v] = enemy->direction.x;
+                facing->z[v] = enemy->direction.z;
+            }
+            HMM_ATan2FArray(facing->x, facing->z, facing->yaw, cull->visible_count);
+#endif
+
+            for (i32 v = 0; v < cull->visible_count; v++) {
+                u32 i = cull->visible[v];
+                Enemy *enemy = &game->enemies[i];
+                f32 yaw = facing->yaw[v] * (180.0f / HMM_PI32);
+                commands->push(MESH_CUBE, {cull->x[i], cull->y[i], cull->z[i]}, {enemy->width, enemy->height, enemy->width}, RED, yaw);
+            }
         }
 
 
         // Draw player
-        Player *player = &game->player;
-        Vector3 pos = player->position;
         f32 a = 1.0f;
         Color faded_blue = ColorAlpha(BLUE, a);
-        DrawCube(pos, player->size, player->size, player->size, faded_blue);
+        commands->push(MESH_CUBE, player_pos, {player->size, player->size, player->size}, faded_blue);
         
 
-        DrawGrid(300, 10);
-        EndMode3D();
+        commands->setStaticGeometry(&game->static_geometry);
+
+        AIScheduler *ai = &game->ai;
+        commands->text(10, 40, 20, LIME, "AI: %d thought, latency avg %.1f max %u steps", ai->thought_count, ai->latency_avg, ai->latency_max);
+    }
+}
+
+
+
+// Frames before --assert-no-alloc starts failing on heap allocations
+#define ALLOCATION_WARMUP_FRAMES 60
+
+// No window: runs the gameplay for a fixed number of 60Hz frames with
+// scripted input and a null render backend, then prints what would have been
+// drawn. Every frame's command stream gets checked; false if one was wrong.
+bool RunHeadless(Game *game, Camera *camera, RenderSnapshots *snapshots, RenderBackend *backend, FrameStats *frame_stats, bool assert_no_alloc, i32 frames, f32 window_width, f32 window_height) {
+    f32 dt = 1.0f / 60.0f;
+    i64 draw_calls = 0;
+    i64 steps = 0;
+    i32 bad_frames = 0;
+    LatencyStats latency;
+    game->profiler.start();
+
+    for (i32 frame = 0; frame < frames; frame++) {
+        // Circle around, firing in a slowly turning direction
+        f32 t = frame * dt;
+        GameInput input = {};
+        input.axis_left.x  = cosf(t * 0.5f);
+        input.axis_left.y  = sinf(t * 0.5f);
+        input.axis_right.x = cosf(t * 2.0f);
+        input.axis_right.y = sinf(t * 2.0f);
+        input.trigger_right = 1.0f;
+        i64 input_time = NowNanoseconds();
+        AllocationScope frame_allocations, stage_allocations;
+        frame_allocations.begin();
+
+        bool forbid_allocations = assert_no_alloc && frame >= ALLOCATION_WARMUP_FRAMES;
+        if (forbid_allocations) ForbidAllocations();
+
+        stage_allocations.begin();
+        i32 frame_steps = game->timestep.advance(dt);
+        game->ai.beginFrame(frame_steps);
+        for (i32 s = 0; s < frame_steps; s++) {
+            UpdateGame(game, input, game->timestep.step());
+        }
+        steps += frame_steps;
+        frame_stats->record(FRAME_STAGE_SIMULATE, MillisecondsSince(input_time));
+        frame_stats->recordAllocations(FRAME_STAGE_SIMULATE, stage_allocations.end());
+
+        i64 build_start = NowNanoseconds();
+        stage_allocations.begin();
+        RenderGame(game, camera, game->timestep.alpha(), window_width, window_height, snapshots->writeBuffer());
+        snapshots->writeBuffer()->input_time = input_time;
+        snapshots->publish();
+        frame_stats->record(FRAME_STAGE_BUILD, MillisecondsSince(build_start));
+        frame_stats->recordAllocations(FRAME_STAGE_BUILD, stage_allocations.end());
+
+        if (forbid_allocations) AllowAllocations();
+
+        i64 submit_start = NowNanoseconds();
+        stage_allocations.begin();
+        RenderCommandBuffer *submitted = snapshots->acquire();
+        backend->submit(submitted);
+        draw_calls += backend->stats.draw_calls;
+        frame_stats->record(FRAME_STAGE_SUBMIT, MillisecondsSince(submit_start));
+        frame_stats->recordAllocations(FRAME_STAGE_SUBMIT, stage_allocations.end());
+
+        latency.add(MillisecondsSince(input_time));
+        frame_stats->record(FRAME_STAGE_FRAME, MillisecondsSince(input_time));
+        frame_stats->recordAllocations(FRAME_STAGE_FRAME, frame_allocations.end());
+
+        // Every bullet, enemy and the player, either drawn or culled, and
+        // each command drawn exactly once
+        RenderStats *stats = &backend->stats;
+        i32 expected = game->bullet_count + game->enemy_count + 1;
+        i32 instances = stats->instances[MESH_CUBE] + stats->instances[MESH_SPHERE];
+        if (!submitted->check(stderr)) {
+            bad_frames++;
+        } else if (submitted->count + submitted->culled != expected || stats->commands != submitted->count || instances != submitted->count) {
+            fprintf(stderr, "command stream: frame %d has %d commands and %d culled for %d objects, %d instances drawn\n",
+                frame, submitted->count, submitted->culled, expected, instances);
+            bad_frames++;
+        }
+    }
+
+    game->profiler.stop();
+
+    RenderStats *stats = &backend->stats;
+    printf("headless: %d frames, %lld steps at %.0fHz, %d enemies left\n", frames, (long long)steps, game->timestep.hz, game->enemy_count);
+    printf("last frame: %d commands (%d culled), %d draw calls, %d cubes, %d spheres, %d texts\n",
+        stats->commands, stats->culled, stats->draw_calls, stats->instances[MESH_CUBE], stats->instances[MESH_SPHERE], stats->texts);
+    printf("static geometry: %d retained vertices drawn per frame, %d uploads\n", stats->static_vertices, stats->static_uploads);
+    printf("average draw calls per frame: %.2f\n", frames ? (f64)draw_calls / frames : 0.0);
+    printf("input to submit latency: p50 %.3f p95 %.3f p99 %.3f max %.3f ms\n",
+        latency.percentile(50), latency.percentile(95), latency.percentile(99), latency.max_ms);
+    frame_stats->print(stdout);
+    printf("command stream: %d of %d frames wrong\n", bad_frames, frames);
+    return bad_frames == 0;
+}
+
+typedef enum CapacityLoad {
+    CAPACITY_ENEMIES = 0,
+    CAPACITY_BULLETS,
+    CAPACITY_LOAD_COUNT
+} capacity_load;
+
+static const char *capacity_load_names[CAPACITY_LOAD_COUNT] = { "enemies", "bullets" };
+
+struct CapacitySettings {
+    f32 budget_ms {1000.0f / 120.0f}; // one frame's worth of simulate + build + submit
+    f64 percentile {99};              // of the measured frames, that has to fit the budget
+    i32 warmup_frames {30};
+    i32 measure_frames {120};
+};
+
+// What the headless scenario runs need besides a Game, which each run makes fresh
+struct ScenarioContext {
+    JobSystem *jobs;
+    Camera camera;
+    RenderSnapshots *snapshots;
+    RenderBackend *backend;
+    f32 sim_hz;
+    FrameStats *stats; // the measured frames of the last run
+
+    bool perf_counters;   // --perf-counters, for the profiler
+    Profiler *profiler;   // if set, gets the scopes of every run's measured frames added
+};
+
+// Point i of n on a sunflower spiral filling a disc, deterministic and evenly spread
+Vector3 SpiralPoint(i32 i, i32 n, f32 radius) {
+    f32 r = radius * sqrtf((i + 0.5f) / n);
+    f32 angle = i * 2.39996323f; // golden angle
+    return { r * cosf(angle), 1, r * sinf(angle) };
+}
+
+// The standard scenario: the player stands in the middle of the arena
+// without shooting. For CAPACITY_ENEMIES, `count` enemies start spread over
+// the arena and close in on the player. For CAPACITY_BULLETS, `count`
+// harmless, parked bullets sit spread over the arena among the usual number
+// of enemies, so the load stays the same for the whole run.
+void SetupScenario(Game *game, CapacityLoad load, i32 count) {
+    i32 enemy_count = load == CAPACITY_ENEMIES ? HMM_MIN(count, Game::max_enemies) : Game::initial_enemies;
+    game->enemy_count = enemy_count;
+    EnemyMotion *motion = &game->motion; // free before the first step
+    for (i32 i = 0; i < enemy_count; i++) {
+        Enemy *enemy = &game->enemies[i];
+        enemy->id = i;
+        enemy->position = SpiralPoint(i, enemy_count, 100.0f);
+        enemy->previous_position = enemy->position;
+        motion->dir_x[i] = -enemy->position.x;
+        motion->dir_z[i] = -enemy->position.z + 1e-3f;
+    }
+    SetEnemyDirections(game, enemy_count);
+
+    if (load == CAPACITY_BULLETS) {
+        i32 bullet_count = HMM_MIN(count, Game::max_bullets);
+        game->bullet_count = bullet_count;
+        for (i32 i = 0; i < bullet_count; i++) {
+            Bullet *bullet = &game->bullets[i];
+            bullet->position = SpiralPoint(i, bullet_count, 100.0f);
+            bullet->previous_position = bullet->position;
+            bullet->direction = {1, 0, 0};
+            bullet->speed = 0;
+            bullet->damage = 0;
+            bullet->lifetime = 1e9f;
+        }
+    }
+}
+
+// Runs the scenario for warmup + measured frames of frame_ms each (as far as
+// the simulation is concerned, they take as long as they take) and records
+// the measured ones into context->stats, and their profiler scopes into
+// context->profiler. Stops early once more than
+// max_over_budget frames took longer than frame_ms, if that's not negative.
+void RunScenario(ScenarioContext *context, CapacityLoad load, i32 count, f32 frame_ms, i32 warmup_frames, i32 measure_frames, i64 max_over_budget) {
+    Game *game = new Game();
+    game->jobs = context->jobs;
+    game->timestep.hz = context->sim_hz;
+    game->profiler.want_counters = context->perf_counters;
+    SetupScenario(game, load, count);
+
+    FrameStats *stats = context->stats;
+    stats->clear();
+    stats->hitch_ms = frame_ms;
+
+    GameInput input = {};
+    Camera camera = context->camera;
+    RenderSnapshots *snapshots = context->snapshots;
+    for (i32 frame = 0; frame < warmup_frames + measure_frames; frame++) {
+        if (frame == warmup_frames) {
+            game->profiler.clear();
+            game->profiler.start();
+        }
+        i64 frame_start = NowNanoseconds();
+
+        i32 steps = game->timestep.advance(frame_ms / 1000.0f);
+        game->ai.beginFrame(steps);
+        for (i32 s = 0; s < steps; s++) {
+            UpdateGame(game, input, game->timestep.step());
+        }
+        f32 simulate_ms = MillisecondsSince(frame_start);
+
+        i64 build_start = NowNanoseconds();
+        RenderGame(game, &camera, game->timestep.alpha(), 1280, 860, snapshots->writeBuffer());
+        snapshots->publish();
+        f32 build_ms = MillisecondsSince(build_start);
+
+        i64 submit_start = NowNanoseconds();
+        context->backend->submit(snapshots->acquire());
+        f32 submit_ms = MillisecondsSince(submit_start);
+
+        if (frame < warmup_frames) continue;
+
+        stats->record(FRAME_STAGE_SIMULATE, simulate_ms);
+        stats->record(FRAME_STAGE_BUILD, build_ms);
+        stats->record(FRAME_STAGE_SUBMIT, submit_ms);
+        stats->record(FRAME_STAGE_FRAME, MillisecondsSince(frame_start));
+        if (max_over_budget >= 0 && stats->hitch_count > max_over_budget) break;
+    }
+
+    game->profiler.stop();
+    if (context->profiler) context->profiler->merge(&game->profiler);
+
+    // A background flow field build may still be using the game
+    if (game->flow_field.building) context->jobs->wait(&game->flow_field.build_counter);
+    delete game;
+}
+
+// Percentile frame time of the scenario at `count`, in ms. Gives up early
+// (and reports the worst frame) once enough frames went over budget that
+// the percentile can't fit any more.
+f32 MeasureCapacityTrial(ScenarioContext *context, CapacityLoad load, i32 count, CapacitySettings *settings) {
+    i64 allowed_over = (i64)((100.0 - settings->percentile) / 100.0 * settings->measure_frames);
+    RunScenario(context, load, count, settings->budget_ms, settings->warmup_frames, settings->measure_frames, allowed_over);
+
+    FrameStats *stats = context->stats;
+    if (stats->hitch_count > allowed_over) return stats->maxMs(FRAME_STAGE_FRAME);
+    return stats->percentileMs(FRAME_STAGE_FRAME, settings->percentile);
+}
+
+// Binary search for the largest count whose percentile frame time fits the
+// budget: doubling up to the first failure, then bisecting to within ~2%.
+i32 FindCapacity(ScenarioContext *context, CapacityLoad load, CapacitySettings *settings) {
+    i32 limit = load == CAPACITY_ENEMIES ? Game::max_enemies : Game::max_bullets;
+    i32 fits = 0;
+    i32 fails = 0;
+
+    for (i32 count = 256; ; count *= 2) {
+        count = HMM_MIN(count, limit);
+        f32 ms = MeasureCapacityTrial(context, load, count, settings);
+        printf("  %s %7d: p%g %.3f ms\n", capacity_load_names[load], count, settings->percentile, ms);
+        if (ms > settings->budget_ms) {
+            fails = count;
+            break;
+        }
+        fits = count;
+        if (count == limit) return limit; // sustains everything there's room for
+    }
+
+    while (fails - fits > HMM_MAX(1, fits / 50)) {
+        i32 count = fits + (fails - fits) / 2;
+        f32 ms = MeasureCapacityTrial(context, load, count, settings);
+        printf("  %s %7d: p%g %.3f ms\n", capacity_load_names[load], count, settings->percentile, ms);
+        if (ms > settings->budget_ms) {
+            fails = count;
+        } else {
+            fits = count;
+        }
+    }
+    return fits;
+}
+
+// Prints the capacity of each requested load, one number per configuration
+void RunCapacity(ScenarioContext *context, bool *loads, CapacitySettings *settings) {
+    for (i32 l = 0; l < CAPACITY_LOAD_COUNT; l++) {
+        if (!loads[l]) continue;
+        CapacityLoad load = (CapacityLoad)l;
+        i32 capacity = FindCapacity(context, load, settings);
+        printf("capacity %s: %d (p%g <= %.2f ms, %.0fHz simulation, %d workers)\n",
+            capacity_load_names[load], capacity, settings->percentile, settings->budget_ms, context->sim_hz, context->jobs->worker_count);
+    }
+}
+
+// Fixed scenarios the benchmark measures, each as a handful of metrics
+struct BenchmarkScenario {
+    const char *name;
+    CapacityLoad load;
+    i32 count;
+};
+
+static const BenchmarkScenario benchmark_scenarios[] = {
+    { "enemies_4k",  CAPACITY_ENEMIES, 4096 },
+    { "enemies_16k", CAPACITY_ENEMIES, 16384 },
+    { "bullets_1k",  CAPACITY_BULLETS, 1024 },
+};
+#define BENCHMARK_SCENARIO_COUNT (i32)(sizeof(benchmark_scenarios) / sizeof(benchmark_scenarios[0]))
+
+// p50 of every stage, plus the frame's p99
+#define BENCHMARK_METRICS_PER_SCENARIO (FRAME_STAGE_COUNT + 1)
+// plus the draw key sort on its own, see MeasureKeySort
+#define BENCHMARK_SORT_METRIC (BENCHMARK_SCENARIO_COUNT * BENCHMARK_METRICS_PER_SCENARIO)
+#define BENCHMARK_METRIC_COUNT (BENCHMARK_SORT_METRIC + 1)
+#define BENCHMARK_MAX_RUNS 64
+
+struct BenchmarkMetric {
+    char name[64];    // scenario/stage_pNN
+    f32 runs[BENCHMARK_MAX_RUNS];
+    i32 run_count;
+
+    // Over the runs
+    f32 median;
+    f32 ci_low;       // ~95% confidence interval of the median
+    f32 ci_high;
+};
+
+struct BenchmarkSettings {
+    i32 runs {5};
+    i32 warmup_frames {30};
+    i32 measure_frames {240};
+    f32 frame_ms {1000.0f / 60.0f}; // simulated time per frame
+    f32 threshold {0.10f};          // relative slowdown of a median that counts as a regression
+
+    const char *out_path {nullptr};
+    const char *baseline_path {nullptr};
+};
+
+// Median of the runs and a distribution-free confidence interval for it:
+// the order statistics k and n-1-k, with k the largest index that still
+// keeps the binomial(n, 1/2) tails under 2.5% each. Below 6 runs no k
+// qualifies, and the interval falls back to the whole range.
+void SummarizeBenchmarkMetric(BenchmarkMetric *metric) {
+    i32 n = metric->run_count;
+    f32 sorted[BENCHMARK_MAX_RUNS];
+    for (i32 i = 0; i < n; i++) {
+        sorted[i] = metric->runs[i];
+    }
+    std::sort(sorted, sorted + n);
+
+    metric->median = (n % 2) ? sorted[n / 2] : 0.5f * (sorted[n / 2 - 1] + sorted[n / 2]);
+
+    i32 k = 0;
+    f64 tail = 0;
+    f64 probability = pow(0.5, n); // P(X = 0)
+    for (i32 i = 0; i < n / 2; i++) {
+        tail += probability;
+        if (tail > 0.025) break;
+        k = i;
+        probability = probability * (n - i) / (i + 1);
+    }
+    metric->ci_low = sorted[k];
+    metric->ci_high = sorted[n - 1 - k];
+}
+
+// 200k draw keys have to sort within 1 ms on one core
+#define BENCHMARK_SORT_KEYS 200000
+#define BENCHMARK_SORT_BUDGET_MS 1.0f
+#define BENCHMARK_SORT_REPEATS 21
+
+// Median time of RenderCommandBuffer::sort() without workers, over keys that
+// push() made for commands spread over the depth range, both layers, both
+// meshes and 64 colors
+f32 MeasureKeySort() {
+    static RenderCommandBuffer *buffer = new RenderCommandBuffer();
+    static u64 keys[BENCHMARK_SORT_KEYS];
+
+    Camera3D camera = {};
+    camera.position = {0, 10, 0};
+    camera.target = {0, 10, 1};
+    camera.up = {0, 1, 0};
+    buffer->begin(camera);
+    SetRandomSeed(1);
+    for (i32 i = 0; i < BENCHMARK_SORT_KEYS; i++) {
+        Vector3 position = {(f32)GetRandomValue(-100, 100), 0, (f32)GetRandomValue(0, 300)};
+        Color color = {(u8)(GetRandomValue(0, 63) * 4), 0, 0, (u8)(GetRandomValue(0, 7) ? 255 : 128)};
+        buffer->push(GetRandomValue(0, 1) ? MESH_CUBE : MESH_SPHERE, position, {1, 1, 1}, color);
+    }
+    memcpy(keys, buffer->keys, sizeof(keys));
+
+    f32 times[BENCHMARK_SORT_REPEATS];
+    for (i32 r = 0; r < BENCHMARK_SORT_REPEATS; r++) {
+        memcpy(buffer->keys, keys, sizeof(keys));
+        buffer->sorted = false;
+        i64 start = NowNanoseconds();
+        buffer->sort(nullptr);
+        times[r] = MillisecondsSince(start);
+    }
+    std::sort(times, times + BENCHMARK_SORT_REPEATS);
+    return times[BENCHMARK_SORT_REPEATS / 2];
+}
+
+// The metrics, then each scenario's profiler scopes over all its runs
+void WriteBenchmarkJson(FILE *out, BenchmarkMetric *metrics, Profiler *profiles, BenchmarkSettings *settings, ScenarioContext *context) {
+    fprintf(out, "{\n  \"runs\": %d,\n  \"measure_frames\": %d,\n  \"sim_hz\": %.1f,\n  \"workers\": %d,\n  \"kernels\": \"%s\",\n  \"metrics\": {\n",
+        settings->runs, settings->measure_frames, context->sim_hz, context->jobs->worker_count, cpu_level_names[simd.level]);
+    for (i32 m = 0; m < BENCHMARK_METRIC_COUNT; m++) {
+        BenchmarkMetric *metric = &metrics[m];
+        fprintf(out, "    \"%s\": {\"median_ms\": %.5f, \"ci_low_ms\": %.5f, \"ci_high_ms\": %.5f, \"runs_ms\": [",
+            metric->name, metric->median, metric->ci_low, metric->ci_high);
+        for (i32 r = 0; r < metric->run_count; r++) {
+            fprintf(out, "%s%.5f", r ? ", " : "", metric->runs[r]);
+        }
+        fprintf(out, "]}%s\n", m + 1 < BENCHMARK_METRIC_COUNT ? "," : "");
+    }
+    // One profile per scenario, after the metrics so ReadBaselineMetric
+    // never has to look past them
+    fprintf(out, "  },\n  \"profiles\": {\n");
+    for (i32 sc = 0; sc < BENCHMARK_SCENARIO_COUNT; sc++) {
+        fprintf(out, "    \"%s\": {\n", benchmark_scenarios[sc].name);
+        profiles[sc].writeJson(out);
+        fprintf(out, "\n    }%s\n", sc + 1 < BENCHMARK_SCENARIO_COUNT ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+}
+
+// Reads back what WriteBenchmarkJson wrote: finds the metric by its quoted
+// name and the fields after it. Not a general JSON parser.
+bool ReadBaselineMetric(const char *json, const char *name, f32 *median, f32 *ci_low, f32 *ci_high) {
+    char key[80];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char *entry = strstr(json, key);
+    if (!entry) return false;
+
+    const char *fields[3] = { "\"median_ms\":", "\"ci_low_ms\":", "\"ci_high_ms\":" };
+    f32 *values[3] = { median, ci_low, ci_high };
+    const char *end = strchr(entry, '}');
+    for (i32 f = 0; f < 3; f++) {
+        const char *field = strstr(entry, fields[f]);
+        if (!field || (end && field > end)) return false;
+        *values[f] = strtof(field + strlen(fields[f]), nullptr);
+    }
+    return true;
+}
+
+// A metric regressed when its median is more than threshold slower than the
+// baseline's and the two confidence intervals don't overlap, so one noisy
+// run can't fail the gate on its own. Returns the number of regressions, or
+// -1 when the baseline can't be read.
+i32 CompareWithBaseline(BenchmarkMetric *metrics, BenchmarkSettings *settings) {
+    FILE *in = fopen(settings->baseline_path, "rb");
+    if (!in) {
+        fprintf(stderr, "could not read baseline %s\n", settings->baseline_path);
+        return -1;
+    }
+    static char json[1 << 16];
+    size_t size = fread(json, 1, sizeof(json) - 1, in);
+    json[size] = 0;
+    fclose(in);
+
+    i32 regressions = 0;
+    printf("%-28s %10s %10s %8s\n", "metric", "baseline", "current", "change");
+    for (i32 m = 0; m < BENCHMARK_METRIC_COUNT; m++) {
+        BenchmarkMetric *metric = &metrics[m];
+        f32 median, ci_low, ci_high;
+        if (!ReadBaselineMetric(json, metric->name, &median, &ci_low, &ci_high)) {
+            printf("%-28s %10s %10.4f %8s\n", metric->name, "-", metric->median, "new");
+            continue;
+        }
+
+        f32 change = median > 0 ? metric->median / median - 1.0f : 0.0f;
+        const char *verdict = "";
+        if (change > settings->threshold && metric->ci_low > ci_high) {
+            verdict = "  REGRESSION";
+            regressions++;
+        } else if (change < -settings->threshold && metric->ci_high < ci_low) {
+            verdict = "  faster";
+        }
+        printf("%-28s %10.4f %10.4f %+7.1f%%%s\n", metric->name, median, metric->median, change * 100.0f, verdict);
+    }
+    return regressions;
+}
+
+// Runs every scenario settings->runs times, reports medians with confidence
+// intervals, optionally writes them as JSON and gates on a baseline.
+// Returns the process exit code: 1 on a regression, 2 on a bad baseline.
+i32 RunBenchmark(ScenarioContext *context, BenchmarkSettings *settings) {
+    static BenchmarkMetric metrics[BENCHMARK_METRIC_COUNT];
+    static Profiler profiles[BENCHMARK_SCENARIO_COUNT];
+    settings->runs = HMM_MAX(1, HMM_MIN(settings->runs, BENCHMARK_MAX_RUNS));
+
+    for (i32 sc = 0; sc < BENCHMARK_SCENARIO_COUNT; sc++) {
+        const BenchmarkScenario *scenario = &benchmark_scenarios[sc];
+        BenchmarkMetric *scenario_metrics = &metrics[sc * BENCHMARK_METRICS_PER_SCENARIO];
+        for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+            snprintf(scenario_metrics[s].name, sizeof(scenario_metrics[s].name), "%s/%s_p50", scenario->name, frame_stage_names[s]);
+        }
+        BenchmarkMetric *frame_p99 = &scenario_metrics[FRAME_STAGE_COUNT];
+        snprintf(frame_p99->name, sizeof(frame_p99->name), "%s/frame_p99", scenario->name);
+
+        context->profiler = &profiles[sc];
+        for (i32 r = 0; r < settings->runs; r++) {
+            RunScenario(context, scenario->load, scenario->count, settings->frame_ms, settings->warmup_frames, settings->measure_frames, -1);
+            for (i32 s = 0; s < FRAME_STAGE_COUNT; s++) {
+                scenario_metrics[s].runs[r] = context->stats->percentileMs((FrameStage)s, 50);
+            }
+            frame_p99->runs[r] = context->stats->percentileMs(FRAME_STAGE_FRAME, 99);
+        }
+        context->profiler = nullptr;
+
+        for (i32 m = 0; m < BENCHMARK_METRICS_PER_SCENARIO; m++) {
+            scenario_metrics[m].run_count = settings->runs;
+            SummarizeBenchmarkMetric(&scenario_metrics[m]);
+            printf("%-28s median %8.4f ms  [%.4f, %.4f]\n", scenario_metrics[m].name,
+                scenario_metrics[m].median, scenario_metrics[m].ci_low, scenario_metrics[m].ci_high);
+        }
+    }
 
-        delete qt;
+    BenchmarkMetric *sort_metric = &metrics[BENCHMARK_SORT_METRIC];
+    snprintf(sort_metric->name, sizeof(sort_metric->name), "sort_200k/sort_p50");
+    for (i32 r = 0; r < settings->runs; r++) {
+        sort_metric->runs[r] = MeasureKeySort();
     }
+    sort_metric->run_count = settings->runs;
+    SummarizeBenchmarkMetric(sort_metric);
+    printf("%-28s median %8.4f ms  [%.4f, %.4f]  budget %.1f ms%s\n", sort_metric->name,
+        sort_metric->median, sort_metric->ci_low, sort_metric->ci_high, BENCHMARK_SORT_BUDGET_MS,
+        sort_metric->median > BENCHMARK_SORT_BUDGET_MS ? ", OVER" : "");
+
+    if (settings->out_path) {
+        FILE *out = fopen(settings->out_path, "w");
+        if (out) {
+            WriteBenchmarkJson(out, metrics, profiles, settings, context);
+            fclose(out);
+        } else {
+            fprintf(stderr, "could not write %s\n", settings->out_path);
+        }
+    }
+
+    if (!settings->baseline_path) return 0;
+
+    i32 regressions = CompareWithBaseline(metrics, settings);
+    if (regressions < 0) return 2;
+    if (regressions > 0) {
+        printf("%d metric(s) regressed by more than %.0f%%\n", regressions, settings->threshold * 100.0f);
+        return 1;
+    }
+    printf("no regressions beyond %.0f%%\n", settings->threshold * 100.0f);
+    return 0;
 }
 
+// Runs the gameplay simulation on its own thread, so a slow frame on either
+// side doesn't hold up the other: frame N+1 gets simulated while the main
+// thread draws frame N. The simulation itself runs in fixed steps, as many
+// as the real time since the last frame calls for. Input and drawing stay on
+// the main thread (raylib wants them there); input comes in through the
+// input ring, frames go out through the snapshots.
+struct SimulationThread {
+    Game *game;
+    Camera3D camera;
+    RenderSnapshots *snapshots;
+    f32 window_width, window_height;
+
+    std::thread thread;
+    std::atomic<bool> running {false};
+    std::atomic<bool> active {false}; // only simulates while set, i.e. during GAMEPLAY
+
+    InputRing *inputs;
+    InputSample input {}; // newest taken from the ring
+
+    bool assert_no_alloc {false};
+    i64 frames_simulated {0};
+
+
+    void start() {
+        running = true;
+        thread = std::thread([this] { loop(); });
+    }
+
+    void stop() {
+        running = false;
+        thread.join();
+    }
+
+    void loop() {
+        auto last_frame = std::chrono::steady_clock::now();
+        game->profiler.start();
+
+        while (running) {
+            // Stay at most one frame ahead of the renderer
+            if (!active || snapshots->pending()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                if (!active) {
+                    last_frame = std::chrono::steady_clock::now();
+                    inputs->popLatest(&input); // don't let it fill up with stale samples
+                }
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<f64> frame_time = now - last_frame;
+            last_frame = now;
+
+            // As late as possible: whatever the main thread read last
+            inputs->popLatest(&input);
+
+            bool forbid_allocations = assert_no_alloc && frames_simulated >= ALLOCATION_WARMUP_FRAMES;
+            if (forbid_allocations) ForbidAllocations();
+
+            AllocationScope allocations;
+            allocations.begin();
+            i64 simulate_start = NowNanoseconds();
+            i32 steps = game->timestep.advance(frame_time.count());
+            game->ai.beginFrame(steps);
+            for (i32 s = 0; s < steps; s++) {
+                UpdateGame(game, input.input, game->timestep.step());
+            }
+            AllocationCount simulate_allocations = allocations.end();
+
+            allocations.begin();
+            i64 build_start = NowNanoseconds();
+            RenderCommandBuffer *frame = snapshots->writeBuffer();
+            RenderGame(game, &camera, game->timestep.alpha(), window_width, window_height, frame);
+            frame->input_time = input.time;
+            frame->simulate_ms = (build_start - simulate_start) / 1e6f;
+            frame->build_ms = MillisecondsSince(build_start);
+            frame->simulate_allocations = simulate_allocations;
+            frame->build_allocations = allocations.end();
+
+            if (forbid_allocations) AllowAllocations();
+            frames_simulated++;
+
+            snapshots->publish();
+        }
+
+        game->profiler.stop();
+    }
+};
 
+// Points the kernel table at the widest variants `level` allows
+void BindSimdKernels(CpuLevel level) {
+    simd.level = level;
+    simd.normalize_vec2_array = HMM_NormalizeVec2Array;
+    simd.add_scaled_vec2_array = HMM_AddScaledVec2Array;
+    simd.length_vec2_array = HMM_LengthVec2Array;
+    simd.cull = CullPositions;
+    simd.resolve_pairs = ResolvePairs;
+    simd.instance_transforms = HMM_InstanceTransforms; // no wider variant yet
+
+#ifdef CPU_DISPATCH
+    if (level >= CPU_LEVEL_AVX2) {
+        simd.normalize_vec2_array = NormalizeVec2ArrayAVX2;
+        simd.add_scaled_vec2_array = AddScaledVec2ArrayAVX2;
+        simd.length_vec2_array = LengthVec2ArrayAVX2;
+        simd.cull = CullPositionsAVX2;
+        simd.resolve_pairs = ResolvePairsAVX2;
+    }
+    if (level >= CPU_LEVEL_AVX512) {
+        simd.normalize_vec2_array = NormalizeVec2ArrayAVX512;
+        simd.add_scaled_vec2_array = AddScaledVec2ArrayAVX512;
+        simd.length_vec2_array = LengthVec2ArrayAVX512;
+        simd.cull = CullPositionsAVX512;
+        simd.resolve_pairs = ResolvePairsAVX512;
+    }
+#endif
+}
 
-int main() {
+int main(int argc, char **argv) {
     u16 window_width = 1280;
     u16 window_height = 860; 
-    SetConfigFlags(FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT );  
-    InitWindow(window_width, window_height, "Basic screen management");
-    //SetTargetFPS(60);
+
+    // --headless [frames] --sim-hz <hz> --stats <file.json|file.csv> --hitch-ms <ms> --assert-no-alloc --perf-counters
+    // --capacity [enemies|bullets] --budget-ms <ms> --percentile <p>
+    // --benchmark [runs] --benchmark-out <file.json> --baseline <file.json> --threshold <percent>
+    // --cpu-level <sse2|sse4.1|avx2|avx512>
+    bool headless = false;
+    i32 headless_frames = 600;
+    f32 sim_hz = 120.0f;
+    bool assert_no_alloc = false;
+    bool perf_counters = false;
+    bool capacity = false;
+    bool capacity_loads[CAPACITY_LOAD_COUNT] = {};
+    CapacitySettings capacity_settings;
+    bool benchmark = false;
+    BenchmarkSettings benchmark_settings;
+    const char *stats_path = nullptr;
+    CpuLevel cpu_level = DetectCpuLevel();
+    CpuLevel detected_cpu_level = cpu_level;
+    FrameStats *frame_stats = new FrameStats();
+    for (i32 i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                headless_frames = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc) {
+            sim_hz = (f32)atof(argv[++i]);
+            sim_hz = HMM_MAX(10.0f, sim_hz);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--hitch-ms") == 0 && i + 1 < argc) {
+            frame_stats->hitch_ms = (f32)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--assert-no-alloc") == 0) {
+            assert_no_alloc = true;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perf_counters = true;
+        } else if (strcmp(argv[i], "--capacity") == 0) {
+            capacity = true;
+            headless = true;
+            bool named = false;
+            for (i32 l = 0; l < CAPACITY_LOAD_COUNT && i + 1 < argc; l++) {
+                if (strcmp(argv[i + 1], capacity_load_names[l]) == 0) {
+                    capacity_loads[l] = true;
+                    named = true;
+                }
+            }
+            if (named) {
+                i++;
+            } else {
+                for (i32 l = 0; l < CAPACITY_LOAD_COUNT; l++) capacity_loads[l] = true;
+            }
+        } else if (strcmp(argv[i], "--budget-ms") == 0 && i + 1 < argc) {
+            capacity_settings.budget_ms = (f32)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--percentile") == 0 && i + 1 < argc) {
+            capacity_settings.percentile = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmark = true;
+            headless = true;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                benchmark_settings.runs = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--benchmark-out") == 0 && i + 1 < argc) {
+            benchmark_settings.out_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            benchmark_settings.baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            benchmark_settings.threshold = (f32)atof(argv[++i]) / 100.0f;
+        } else if (strcmp(argv[i], "--cpu-level") == 0 && i + 1 < argc) {
+            // Lower than detected, to compare variants on one machine
+            CpuLevel requested;
+            if (!ParseCpuLevel(argv[++i], &requested)) {
+                fprintf(stderr, "unknown cpu level %s\n", argv[i]);
+            } else if (requested > detected_cpu_level) {
+                fprintf(stderr, "cpu level %s not supported here, using %s\n", argv[i], cpu_level_names[detected_cpu_level]);
+            } else {
+                cpu_level = requested;
+            }
+        }
+    }
+
+    BindSimdKernels(cpu_level);
+    if (headless) {
+        printf("kernels: %s (cpu supports %s)\n", cpu_level_names[cpu_level], cpu_level_names[detected_cpu_level]);
+    }
+
+    if (!headless) {
+        SetConfigFlags(FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT );  
+        InitWindow(window_width, window_height, "Basic screen management");
+        //SetTargetFPS(60);
+    }
 
     Game *game = new Game();
+    game->timestep.hz = sim_hz;
+    game->profiler.want_counters = perf_counters;
+    frame_stats->profiler = &game->profiler;
+
+    RenderSnapshots *snapshots = new RenderSnapshots();
+    snapshots->init();
+
+    JobSystem *jobs = new JobSystem();
+    jobs->start((i32)std::thread::hardware_concurrency() - 1);
+    game->jobs = jobs;
+
+    RenderBackend *backend = new RenderBackend();
+    backend->init(headless ? RENDER_BACKEND_NULL : RENDER_BACKEND_RAYLIB, jobs);
 
     // Camera
     Camera3D camera = {};
@@ -400,12 +1942,23 @@ int main() {
     camera.fovy = 45.0f;
     camera.projection = CAMERA_PERSPECTIVE;
 
+    if (capacity || benchmark) {
+        ScenarioContext context = { jobs, camera, snapshots, backend, sim_hz, frame_stats, perf_counters, nullptr };
+        i32 exit_code = 0;
+        if (capacity) RunCapacity(&context, capacity_loads, &capacity_settings);
+        if (benchmark) exit_code = RunBenchmark(&context, &benchmark_settings);
+        if (game->flow_field.building) jobs->wait(&game->flow_field.build_counter);
+        jobs->stop();
+        return exit_code;
+    }
+
 
     // Initialize enemies randomly
 
-    i32 enemy_count = game->max_enemies;
+    i32 enemy_count = game->initial_enemies;
     game->enemy_count = enemy_count;
-    for (i16 i = 0; i < enemy_count; i++) {
+    EnemyMotion *motion = &game->motion;
+    for (i32 i = 0; i < enemy_count; i++) {
         Enemy *enemy = &game->enemies[i];
         enemy->id = i;
         enemy->position = {
@@ -413,12 +1966,34 @@ int main() {
             1,
             (f32)GetRandomValue(-100, 100), 
         };
-        f32 dir_x = f32(GetRandomValue(-100, 100)) / 100.0f;
-        f32 dir_z = f32(GetRandomValue(-100, 100)) / 100.0f;
-        hmm_v2 norm = HMM_NormalizeVec2( HMM_Vec2(dir_x, dir_z) );
-        enemy->direction = { norm.X, 0.0, norm.Y };
+        motion->dir_x[i] = f32(GetRandomValue(-100, 100)) / 100.0f;
+        motion->dir_z[i] = f32(GetRandomValue(-100, 100)) / 100.0f;
+        enemy->previous_position = enemy->position;
     }
+    SetEnemyDirections(game, enemy_count);
     
+    if (headless) {
+        bool commands_ok = RunHeadless(game, &camera, snapshots, backend, frame_stats, assert_no_alloc, headless_frames, window_width, window_height);
+        if (stats_path && !frame_stats->write(stats_path)) {
+            fprintf(stderr, "could not write %s\n", stats_path);
+        }
+        // A background flow field build may still be using the game
+        if (game->flow_field.building) jobs->wait(&game->flow_field.build_counter);
+        jobs->stop();
+        return commands_ok ? 0 : 1;
+    }
+
+    InputRing *inputs = new InputRing();
+
+    SimulationThread *simulation = new SimulationThread();
+    simulation->inputs = inputs;
+    simulation->assert_no_alloc = assert_no_alloc;
+    simulation->game = game;
+    simulation->camera = camera;
+    simulation->snapshots = snapshots;
+    simulation->window_width = window_width;
+    simulation->window_height = window_height;
+    simulation->start();
 
     GameScreen game_screen = TITLE;
     int frame_count = 0;
@@ -426,10 +2001,18 @@ int main() {
     // Font setup 
     int font_size = 64;
 
+    // From reading the input to the end of drawing the frame that saw it
+    LatencyStats latency;
+    i64 last_present = NowNanoseconds();
+
     while (!WindowShouldClose()) {
         
         // Handle input
+        AllocationScope frame_allocations;
+        frame_allocations.begin();
+
         GameInput input = {};
+        i64 input_time = NowNanoseconds(); // raylib polled the devices at the end of the last frame
         {
             int game_pad_num = 0;
             if (IsKeyPressed(KEY_ENTER) || IsGamepadButtonPressed(game_pad_num, GAMEPAD_BUTTON_MIDDLE_RIGHT)) {
@@ -486,7 +2069,7 @@ int main() {
                     should_fire = true;
                 }
 
-                game->player.pulling_trigger = should_fire;
+                input.pulling_trigger = should_fire;
                 
                 input.axis_right.x = GetGamepadAxisMovement(game_pad_num, GAMEPAD_AXIS_RIGHT_X);
                 input.axis_right.x += x_dir;
@@ -502,9 +2085,12 @@ int main() {
             
         }
 
+        inputs->push({input, input_time});
+
 
         {
             frame_count++;
+            RenderCommandBuffer *presented = nullptr; // if new this frame
             BeginDrawing();
             ClearBackground(BLACK);
             
@@ -513,8 +2099,10 @@ int main() {
 
                 case LOGO:
                 case TITLE: {
-                    if (input.button_start)
+                    if (input.button_start) {
                         game_screen = GAMEPLAY;
+                        simulation->active = true;
+                    }
 
                     // Draw the "title screen"
                     {
@@ -526,11 +2114,26 @@ int main() {
 
 
                 case GAMEPLAY: {
-                    if (input.button_back)
+                    if (input.button_back) {
                         game_screen = TITLE;    
+                        simulation->active = false;
+                    }
+
+                    // Whatever the simulation finished last
+                    RenderCommandBuffer *snapshot = snapshots->acquire();
+                    if (snapshot) {
+                        i64 submit_start = NowNanoseconds();
+                        AllocationScope submit_allocations;
+                        submit_allocations.begin();
+                        backend->submit(snapshot);
+                        frame_stats->record(FRAME_STAGE_SUBMIT, MillisecondsSince(submit_start));
+                        frame_stats->recordAllocations(FRAME_STAGE_SUBMIT, submit_allocations.end());
+                        if (snapshots->fresh) presented = snapshot;
+                    }
 
-                    f32 dt = GetFrameTime();
-                    UpdateAndRender(game, &camera, input, dt, window_width, window_height);
+                    DrawText(TextFormat("input latency p50 %.1f p95 %.1f p99 %.1f ms", latency.percentile(50), latency.percentile(95), latency.percentile(99)),
+                        10, 70, 20, LIME);
+                    frame_stats->drawOverlay(10, 100, 16, LIME);
                 }
                 break;
 
@@ -550,9 +2153,33 @@ int main() {
 
             DrawFPS(10, 10);
             EndDrawing();
+
+            // Each simulated frame counts once, when it's first shown
+            if (presented) {
+                if (presented->input_time) latency.add(MillisecondsSince(presented->input_time));
+                frame_stats->record(FRAME_STAGE_SIMULATE, presented->simulate_ms);
+                frame_stats->record(FRAME_STAGE_BUILD, presented->build_ms);
+                frame_stats->recordAllocations(FRAME_STAGE_SIMULATE, presented->simulate_allocations);
+                frame_stats->recordAllocations(FRAME_STAGE_BUILD, presented->build_allocations);
+            }
+            frame_stats->record(FRAME_STAGE_FRAME, MillisecondsSince(last_present));
+            frame_stats->recordAllocations(FRAME_STAGE_FRAME, frame_allocations.end()); // the main thread's
+            last_present = NowNanoseconds();
         }
     }
 
+    // The profiler belongs to the simulation thread until it's stopped
+    simulation->stop();
+
+    printf("input to present latency: p50 %.2f p95 %.2f p99 %.2f max %.2f ms (%d frames)\n",
+        latency.percentile(50), latency.percentile(95), latency.percentile(99), latency.max_ms, latency.count);
+    frame_stats->print(stdout);
+    if (stats_path && !frame_stats->write(stats_path)) {
+        fprintf(stderr, "could not write %s\n", stats_path);
+    }
+
+    if (game->flow_field.building) jobs->wait(&game->flow_field.build_counter);
+    jobs->stop();
     //CloseWindow();
 
     return 0;
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "HandMadeMath.h"
+#include "defines.h"
+#include "allocations.h"
+#include "input.h"
+
+typedef enum PerfCounter {
+    PERF_COUNTER_CYCLES = 0,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_L1D_MISSES,
+    PERF_COUNTER_LLC_MISSES,
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} perf_counter;
+
+static const char *perf_counter_names[PERF_COUNTER_COUNT] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+
+// Hardware counters of the calling thread, user space only (so the default
+// perf_event_paranoid of 2 is enough), read together as one perf_event group.
+// Counters that can't be opened are left out and read as 0: VMs and
+// containers often have no PMU at all, in which case none open and status
+// says why.
+struct PerfCounters {
+    i32 fds[PERF_COUNTER_COUNT] {-1, -1, -1, -1, -1};
+    i32 group_index[PERF_COUNTER_COUNT] {-1, -1, -1, -1, -1}; // in the group read, -1 if not open
+    i32 open_count {0};
+    char status[128] {"off"};
+
+
+    bool open() {
+#ifdef __linux__
+        static const u64 configs[PERF_COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+        static const u32 types[PERF_COUNTER_COUNT] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        };
+
+        i32 leader = -1;
+        i32 first_error = 0;
+        for (i32 c = 0; c < PERF_COUNTER_COUNT; c++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[c];
+            attr.config = configs[c];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            i32 fd = (i32)syscall(SYS_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */, leader, 0);
+            if (fd < 0) {
+                if (!first_error) first_error = errno;
+                continue;
+            }
+            if (leader < 0) leader = fd;
+            fds[c] = fd;
+            group_index[c] = open_count++;
+        }
+
+        if (open_count == 0) {
+            snprintf(status, sizeof(status), "unavailable: %s", strerror(first_error));
+            return false;
+        }
+        snprintf(status, sizeof(status), "%d of %d counters", open_count, (i32)PERF_COUNTER_COUNT);
+        return true;
+#else
+        snprintf(status, sizeof(status), "unavailable: needs Linux perf_event_open");
+        return false;
+#endif
+    }
+
+    // Keeps group_index, so it's still known which counters were read
+    void close() {
+#ifdef __linux__
+        // Members before the leader
+        for (i32 c = PERF_COUNTER_COUNT - 1; c >= 0; c--) {
+            if (fds[c] >= 0) ::close(fds[c]);
+            fds[c] = -1;
+        }
+#endif
+        open_count = 0;
+    }
+
+    // Running totals, scaled up if the kernel had to multiplex the group
+    // off the PMU for a while. False (and all 0) when nothing is open.
+    bool read(u64 *values) {
+        for (i32 c = 0; c < PERF_COUNTER_COUNT; c++) {
+            values[c] = 0;
+        }
+        if (open_count == 0) return false;
+
+#ifdef __linux__
+        i32 leader = -1;
+        for (i32 c = 0; c < PERF_COUNTER_COUNT && leader < 0; c++) {
+            leader = fds[c];
+        }
+
+        // nr, time_enabled, time_running, then one value per member
+        u64 data[3 + PERF_COUNTER_COUNT];
+        if (::read(leader, data, sizeof(data)) < (ssize_t)(3 * sizeof(u64))) return false;
+
+        u64 enabled = data[1];
+        u64 running = data[2];
+        for (i32 c = 0; c < PERF_COUNTER_COUNT; c++) {
+            if (group_index[c] < 0 || (u64)group_index[c] >= data[0]) continue;
+            u64 value = data[3 + group_index[c]];
+            values[c] = (running && running < enabled) ? (u64)((f64)value * enabled / running) : value;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+struct ProfileScopeStats {
+    const char *name;
+    i64 calls;
+    f64 ms;
+    u64 counters[PERF_COUNTER_COUNT];
+    AllocationCount allocations;
+};
+
+// Named scopes of one thread: wall time and heap allocations always, hardware
+// counters when counters are open. Scopes may nest; each counts everything
+// inside it. Work a scope hands to the job system's workers only shows up as
+// its wall time, the counters and allocations are the calling thread's.
+struct Profiler {
+    static constexpr i32 max_scopes {32};
+
+    bool want_counters {false}; // --perf-counters
+    bool counting {false};
+    PerfCounters perf;
+
+    ProfileScopeStats scopes[max_scopes];
+    i32 scope_count {0};
+
+
+    // On the thread whose scopes get profiled, before the first one
+    void start() {
+        if (want_counters && !counting) {
+            counting = perf.open();
+            if (!counting) {
+                fprintf(stderr, "perf counters %s, timing scopes only\n", perf.status);
+            }
+        }
+    }
+
+    // Closes the counters, what they counted stays for reporting
+    void stop() {
+        perf.close();
+    }
+
+    // Forgets the scopes so far, e.g. what a warm-up recorded
+    void clear() {
+        scope_count = 0;
+    }
+
+    // Adds other's scopes to these, by name. Takes its counter status along
+    // when it was counting, for reporting.
+    void merge(const Profiler *other) {
+        for (i32 s = 0; s < other->scope_count; s++) {
+            const ProfileScopeStats *from = &other->scopes[s];
+            ProfileScopeStats *stats = &scopes[scopeIndex(from->name)];
+            stats->calls += from->calls;
+            stats->ms += from->ms;
+            for (i32 c = 0; c < PERF_COUNTER_COUNT; c++) {
+                stats->counters[c] += from->counters[c];
+            }
+            stats->allocations.count += from->allocations.count;
+            stats->allocations.bytes += from->allocations.bytes;
+        }
+        if (other->counting || !counting) {
+            counting = other->counting;
+            memcpy(perf.group_index, other->perf.group_index, sizeof(perf.group_index));
+            memcpy(perf.status, other->perf.status, sizeof(perf.status));
+        }
+    }
+
+    // Names are compared by pointer first, string literals make that the usual hit
+    i32 scopeIndex(const char *name) {
+        for (i32 s = 0; s < scope_count; s++) {
+            if (scopes[s].name == name) return s;
+        }
+        for (i32 s = 0; s < scope_count; s++) {
+            if (strcmp(scopes[s].name, name) == 0) return s;
+        }
+        if (scope_count == max_scopes) return max_scopes - 1; // shares the last one
+
+        ProfileScopeStats *stats = &scopes[scope_count];
+        *stats = {};
+        stats->name = name;
+        return scope_count++;
+    }
+
+    void print(FILE *out) {
+        fprintf(out, "perf counters: %s\n", perf.status);
+        for (i32 s = 0; s < scope_count; s++) {
+            ProfileScopeStats *stats = &scopes[s];
+            fprintf(out, "  %-18s %8lld calls %10.3f ms %8lld allocations (%lld bytes)", stats->name, (long long)stats->calls, stats->ms,
+                (long long)stats->allocations.count, (long long)stats->allocations.bytes);
+            if (counting) {
+                u64 cycles = stats->counters[PERF_COUNTER_CYCLES];
+                fprintf(out, "  ipc %.2f  l1d %llu  llc %llu  branch %llu",
+                    cycles ? (f64)stats->counters[PERF_COUNTER_INSTRUCTIONS] / cycles : 0.0,
+                    (unsigned long long)stats->counters[PERF_COUNTER_L1D_MISSES],
+                    (unsigned long long)stats->counters[PERF_COUNTER_LLC_MISSES],
+                    (unsigned long long)stats->counters[PERF_COUNTER_BRANCH_MISSES]);
+            }
+            fprintf(out, "\n");
+        }
+    }
+
+    // The "perf_counters" and "scopes" members of an enclosing object
+    void writeJson(FILE *out) {
+        fprintf(out, "  \"perf_counters\": \"%s\",\n  \"scopes\": {\n", perf.status);
+        for (i32 s = 0; s < scope_count; s++) {
+            ProfileScopeStats *stats = &scopes[s];
+            fprintf(out, "    \"%s\": {\"calls\": %lld, \"total_ms\": %.4f, \"mean_us\": %.3f, \"allocations\": %lld, \"allocated_bytes\": %lld",
+                stats->name, (long long)stats->calls, stats->ms, stats->calls ? stats->ms * 1000.0 / stats->calls : 0.0,
+                (long long)stats->allocations.count, (long long)stats->allocations.bytes);
+            for (i32 c = 0; c < PERF_COUNTER_COUNT; c++) {
+                if (counting && perf.group_index[c] >= 0) {
+                    fprintf(out, ", \"%s\": %llu", perf_counter_names[c], (unsigned long long)stats->counters[c]);
+                } else {
+                    fprintf(out, ", \"%s\": null", perf_counter_names[c]);
+                }
+            }
+            fprintf(out, "}%s\n", s + 1 < scope_count ? "," : "");
+        }
+        fprintf(out, "  }");
+    }
+};
+
+// Adds the time, allocations (and counters) between begin() and end() to the
+// named scope
+struct ProfileScope {
+    Profiler *profiler;
+    i32 index;
+    i64 start_time;
+    u64 start[PERF_COUNTER_COUNT];
+    AllocationScope allocations;
+
+
+    void begin(Profiler *owner, const char *name) {
+        profiler = owner;
+        index = profiler->scopeIndex(name);
+        if (profiler->counting) profiler->perf.read(start);
+        allocations.begin();
+        start_time = NowNanoseconds();
+    }
+
+    void end() {
+        f64 ms = (NowNanoseconds() - start_time) / 1e6;
+        AllocationCount allocated = allocations.end();
+        ProfileScopeStats *stats = &profiler->scopes[index];
+        stats->calls++;
+        stats->ms += ms;
+        stats->allocations.count += allocated.count;
+        stats->allocations.bytes += allocated.bytes;
+
+        if (profiler->counting) {
+            u64 now[PERF_COUNTER_COUNT];
+            profiler->perf.read(now);
+            for (i32 c = 0; c < PERF_COUNTER_COUNT; c++) {
+                if (now[c] > start[c]) stats->counters[c] += now[c] - start[c]; // scaling can wobble
+            }
+        }
+    }
+};
@@ -0,0 +1,656 @@
+#pragma once
+
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vendor/raylib/include/raylib.h"
+#include "HandMadeMath.h"
+#include "defines.h"
+#include "jobs.h"
+#include "allocations.h"
+#include "cpu.h"
+
+// The simulation doesn't draw anything itself: it writes compact render
+// commands into a RenderCommandBuffer, which gets sorted by draw key so that
+// everything sharing a layer, mesh and material is contiguous. A backend then
+// turns every such run into a single instanced draw, or, for headless runs,
+// only counts.
+
+typedef enum RenderLayer {
+    RENDER_LAYER_OPAQUE = 0,
+    RENDER_LAYER_TRANSPARENT, // after everything opaque, back to front
+} render_layer;
+
+typedef enum RenderMesh {
+    MESH_CUBE = 0,   // unit cube, centered
+    MESH_SPHERE,     // unit radius
+    MESH_COUNT
+} render_mesh;
+
+// 64 bit draw key, from the most significant bits down:
+//   unused 13 | layer 1 | mesh 2 | material 8 | depth 8 | command index 32
+// Layer, mesh and material are the draw state, the index says which command
+// a sorted key belongs to. Opaque commands sort roughly front to back within
+// a state; depth is kept coarse, and the state narrow, because every 10 bits
+// cost a sorting pass.
+#define DRAW_KEY_INDEX_BITS 32
+#define DRAW_KEY_DEPTH_BITS 8
+#define DRAW_KEY_STATE_SHIFT (DRAW_KEY_INDEX_BITS + DRAW_KEY_DEPTH_BITS)
+#define DRAW_KEY_MESH_SHIFT 8   // within the state
+#define DRAW_KEY_LAYER_SHIFT 10 // within the state
+#define RENDER_DEPTH_RANGE 256.0f // view distance that maps to the largest depth
+
+static_assert(MESH_COUNT <= (1 << (DRAW_KEY_LAYER_SHIFT - DRAW_KEY_MESH_SHIFT)), "meshes don't fit the draw key");
+
+// Sorting the 19 bits of state and depth takes 2 passes of 10 bits
+#define DRAW_KEY_RADIX_BITS 10
+#define DRAW_KEY_RADIX_SIZE (1 << DRAW_KEY_RADIX_BITS)
+#define DRAW_KEY_SORT_PASSES 2
+
+struct RenderCommand {
+    Vector3 position;
+    Vector3 scale;
+    f32 yaw;          // degrees around the y axis
+    Color color;
+    u8 mesh;
+};
+
+inline bool ColorsEqual(Color a, Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+struct RenderText {
+    char text[96];
+    i32 x, y;
+    i32 size;
+    Color color;
+};
+
+// Versions handed out by StaticGeometry::bake(), unique across every Game, so
+// a copy of one game's geometry is never mistaken for another's
+static std::atomic<u32> static_geometry_versions {0};
+
+// World geometry that doesn't change while a level is loaded (the ground grid,
+// later props), baked into a single mesh that is drawn with one call. Whoever
+// owns it calls bake() when the level changes; each render snapshot takes its
+// own copy of it, and the backend re-uploads when it sees a new version.
+struct StaticGeometry {
+    static constexpr i32 max_quads {8192}; // 16 bit indices
+
+    u32 level {0};   // level the geometry was built for, 0 for none yet
+    u32 version {0}; // set by bake(), 0 for never baked
+
+    i32 quad_count {0};
+    f32 vertices[max_quads * 4 * 3];
+    u8  colors[max_quads * 4 * 4];
+
+
+    void clear() {
+        quad_count = 0;
+    }
+
+    // Corners counter clockwise, seen from the visible side
+    void addQuad(Vector3 a, Vector3 b, Vector3 c, Vector3 d, Color color) {
+        if (quad_count >= max_quads) return;
+
+        Vector3 corners[4] = {a, b, c, d};
+        for (i32 k = 0; k < 4; k++) {
+            i32 vertex = quad_count * 4 + k;
+            vertices[vertex * 3 + 0] = corners[k].x;
+            vertices[vertex * 3 + 1] = corners[k].y;
+            vertices[vertex * 3 + 2] = corners[k].z;
+            colors[vertex * 4 + 0] = color.r;
+            colors[vertex * 4 + 1] = color.g;
+            colors[vertex * 4 + 2] = color.b;
+            colors[vertex * 4 + 3] = color.a;
+        }
+        quad_count++;
+    }
+
+    // Same lines as DrawGrid(slices, spacing), as thin quads on the ground
+    void addGrid(i32 slices, f32 spacing, f32 thickness) {
+        i32 half_slices = slices / 2;
+        f32 extent = half_slices * spacing;
+        f32 t = thickness / 2;
+
+        for (i32 i = -half_slices; i <= half_slices; i++) {
+            Color color = (i == 0) ? Color{128, 128, 128, 255} : Color{191, 191, 191, 255};
+            f32 at = i * spacing;
+            addQuad({at - t, 0, -extent}, {at - t, 0, extent}, {at + t, 0, extent}, {at + t, 0, -extent}, color);
+            addQuad({-extent, 0, at + t}, {extent, 0, at + t}, {extent, 0, at - t}, {-extent, 0, at - t}, color);
+        }
+    }
+
+    void bake(u32 for_level) {
+        level = for_level;
+        version = ++static_geometry_versions;
+    }
+
+    // Only the quads in use are copied
+    void copyFrom(const StaticGeometry *other) {
+        level = other->level;
+        version = other->version;
+        quad_count = other->quad_count;
+        memcpy(vertices, other->vertices, sizeof(f32) * quad_count * 4 * 3);
+        memcpy(colors, other->colors, sizeof(u8) * quad_count * 4 * 4);
+    }
+};
+
+struct RenderCommandBuffer {
+    static constexpr i32 max_commands {1 << 18};
+    static constexpr i32 max_texts {16};
+
+    Camera3D camera;
+    Color background {0, 0, 0, 255};
+    // Drawn before the commands, if has_static_geometry. The snapshot's own
+    // copy: the producer may rebuild its geometry while the backend draws this.
+    StaticGeometry static_geometry;
+    bool has_static_geometry {false};
+
+    RenderCommand commands[max_commands];
+    i32 count {0};
+    i32 culled {0}; // left out by the simulation's frustum culling
+
+    // Colors, indexed by the material bits of the draw key. Kept across
+    // frames; past max_materials, colors share the last slot, and the backend
+    // splits that slot's runs wherever the color changes.
+    static constexpr i32 max_materials {256};
+    Color materials[max_materials];
+    i32 material_count {0};
+
+    // Draw keys, see sort()
+    static constexpr i32 sort_chunks {16};
+    u64 keys[max_commands];
+    u64 sort_scratch[max_commands];
+    u64 *sorted_keys {keys};
+    u32 histograms[sort_chunks][DRAW_KEY_SORT_PASSES][DRAW_KEY_RADIX_SIZE];
+    i32 chunk_count {1};
+    i32 chunk_size {0};
+    i32 sort_pass {0};
+    bool count_next_pass {false}; // whether ScatterJob also counts the next digit
+    u64 *sort_from {nullptr};
+    u64 *sort_to {nullptr};
+
+    // Depth of a command is its distance along the view direction
+    hmm_vec3 view_position;
+    hmm_vec3 view_forward;
+    bool sorted {false};
+
+    RenderText texts[max_texts]; // 2D overlay, drawn after the 3D pass
+    i32 text_count {0};
+
+    i64 input_time {0}; // NowNanoseconds() of the newest input the frame saw, 0 if none
+    f32 simulate_ms {0}; // what producing the frame took, for the frame stats
+    f32 build_ms {0};
+    AllocationCount simulate_allocations {};
+    AllocationCount build_allocations {};
+
+
+    // Starts a frame seen through view_camera
+    void begin(Camera3D view_camera) {
+        count = 0;
+        culled = 0;
+        text_count = 0;
+        has_static_geometry = false;
+        sorted = false;
+
+        camera = view_camera;
+        Vector3 from = camera.position;
+        Vector3 to = camera.target;
+        view_position = HMM_Vec3(from.x, from.y, from.z);
+        view_forward = HMM_NormalizeVec3(HMM_Vec3(to.x - from.x, to.y - from.y, to.z - from.z));
+    }
+
+    // Draws geometry this frame. Copied only when it changed since this
+    // buffer last held it, so with a fixed level that's once per buffer.
+    void setStaticGeometry(const StaticGeometry *geometry) {
+        if (static_geometry.version != geometry->version) {
+            static_geometry.copyFrom(geometry);
+        }
+        has_static_geometry = true;
+    }
+
+    u8 material(Color color) {
+        for (i32 i = 0; i < material_count; i++) {
+            if (ColorsEqual(materials[i], color)) return (u8)i;
+        }
+        if (material_count == max_materials) return max_materials - 1;
+
+        materials[material_count] = color;
+        return (u8)material_count++;
+    }
+
+    void push(RenderMesh mesh, Vector3 position, Vector3 scale, Color color, f32 yaw = 0) {
+        if (count >= max_commands) return;
+
+        const u32 depth_max = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+        f32 distance = HMM_DotVec3(HMM_SubtractVec3(HMM_Vec3(position.x, position.y, position.z), view_position), view_forward);
+        u32 depth = (u32)HMM_Clamp(0.0f, distance * (depth_max / RENDER_DEPTH_RANGE), (f32)depth_max);
+
+        RenderLayer layer = color.a < 255 ? RENDER_LAYER_TRANSPARENT : RENDER_LAYER_OPAQUE;
+        if (layer == RENDER_LAYER_TRANSPARENT) {
+            depth = depth_max - depth;
+        }
+        u64 state = ((u64)layer << DRAW_KEY_LAYER_SHIFT) | ((u64)mesh << DRAW_KEY_MESH_SHIFT) | material(color);
+        keys[count] = (state << DRAW_KEY_STATE_SHIFT) | ((u64)depth << DRAW_KEY_INDEX_BITS) | (u64)count;
+
+        RenderCommand *command = &commands[count++];
+        command->position = position;
+        command->scale = scale;
+        command->yaw = yaw;
+        command->color = color;
+        command->mesh = (u8)mesh;
+    }
+
+    // Whether the slot is shared by all colors past max_materials
+    bool sharedMaterial(u8 slot) {
+        return material_count == max_materials && slot == max_materials - 1;
+    }
+
+    // printf-style; raylib's TextFormat isn't safe to call off the main thread
+    void text(i32 x, i32 y, i32 size, Color color, const char *format, ...) {
+        if (text_count >= max_texts) return;
+
+        RenderText *t = &texts[text_count++];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(t->text, sizeof(t->text), format, args);
+        va_end(args);
+        t->x = x;
+        t->y = y;
+        t->size = size;
+        t->color = color;
+    }
+
+    // LSD radix sort of keys[] on the bits above the index, DRAW_KEY_RADIX_BITS
+    // per pass. Keys are pushed in index order and every pass is stable, so the
+    // index bits never need sorting, and passes over a digit that all keys
+    // share are skipped. With workers, the keys are split into chunks that
+    // count and scatter in parallel, each into its own slots. A single chunk
+    // counts the next digit while it scatters, saving a read per pass.
+    //
+    // The budget is 200k keys in 1 ms on one core; --benchmark measures it as
+    // sort_200k. Known gap: on a single vCPU Xeon VM this takes about 1.65 ms
+    // (2.7 ms with the three 8 bit passes before), where one counting pass
+    // alone costs 0.5 to 0.9 ms, so two passes don't fit there.
+    void sort(JobSystem *jobs) {
+        // A snapshot can be drawn more than once, and sorting reuses keys[]
+        if (sorted) return;
+        sorted = true;
+
+        sorted_keys = keys;
+        if (!count) return;
+
+        // Small frames aren't worth waking the workers for
+        i32 threads = jobs ? jobs->worker_count + 1 : 1;
+        chunk_count = HMM_MAX(1, HMM_MIN(HMM_MIN(sort_chunks, threads), count / 16384));
+        chunk_size = (count + chunk_count - 1) / chunk_count;
+
+        sort_from = keys;
+        sort_to = sort_scratch;
+        bool counted = false;
+        for (sort_pass = 0; sort_pass < DRAW_KEY_SORT_PASSES; sort_pass++) {
+            if (!counted) {
+                forChunks(jobs, HistogramJob);
+            }
+
+            // Turn the counts into each chunk's first slot per digit
+            u32 running = 0;
+            bool shared_digit = false;
+            for (i32 digit = 0; digit < DRAW_KEY_RADIX_SIZE; digit++) {
+                u32 digit_begin = running;
+                for (i32 chunk = 0; chunk < chunk_count; chunk++) {
+                    u32 digit_count = histograms[chunk][sort_pass][digit];
+                    histograms[chunk][sort_pass][digit] = running;
+                    running += digit_count;
+                }
+                if (running - digit_begin == (u32)count) {
+                    shared_digit = true;
+                    break;
+                }
+            }
+            if (shared_digit) {
+                counted = false;
+                continue;
+            }
+
+            count_next_pass = chunk_count == 1 && sort_pass + 1 < DRAW_KEY_SORT_PASSES;
+            forChunks(jobs, ScatterJob);
+            counted = count_next_pass;
+
+            u64 *swap = sort_from;
+            sort_from = sort_to;
+            sort_to = swap;
+        }
+        sorted_keys = sort_from;
+    }
+
+    // Consistency of a sorted frame, for headless runs: the keys in strictly
+    // increasing order, each command index used once, and each key's layer,
+    // mesh and material matching its command. Prints the first problem.
+    bool check(FILE *out) {
+        const u64 index_mask = (1ull << DRAW_KEY_INDEX_BITS) - 1;
+        u64 index_sum = 0;
+        for (i32 k = 0; k < count; k++) {
+            u64 key = sorted_keys[k];
+            u64 index = key & index_mask;
+            if (k && key <= sorted_keys[k - 1]) {
+                fprintf(out, "command stream: key %d out of order\n", k);
+                return false;
+            }
+            if (index >= (u64)count) {
+                fprintf(out, "command stream: key %d points at command %llu of %d\n", k, (unsigned long long)index, count);
+                return false;
+            }
+            index_sum += index;
+
+            RenderCommand *command = &commands[index];
+            u64 state = key >> DRAW_KEY_STATE_SHIFT;
+            RenderLayer layer = command->color.a < 255 ? RENDER_LAYER_TRANSPARENT : RENDER_LAYER_OPAQUE;
+            u8 slot = (u8)(state & 0xFF);
+            if ((state >> DRAW_KEY_LAYER_SHIFT) != (u64)layer ||
+                ((state >> DRAW_KEY_MESH_SHIFT) & ((1 << (DRAW_KEY_LAYER_SHIFT - DRAW_KEY_MESH_SHIFT)) - 1)) != command->mesh ||
+                (!sharedMaterial(slot) && !ColorsEqual(materials[slot], command->color))) {
+                fprintf(out, "command stream: state of key %d doesn't match command %llu\n", k, (unsigned long long)index);
+                return false;
+            }
+        }
+        // Distinct and all below count, so this only adds up if each is there once
+        if (index_sum != (u64)count * (u64)(count - 1) / 2) {
+            fprintf(out, "command stream: command indices repeat\n");
+            return false;
+        }
+        return true;
+    }
+
+    void forChunks(JobSystem *jobs, JobFunc *func) {
+        if (jobs && chunk_count > 1) {
+            jobs->parallelFor(chunk_count, 1, func, this);
+        }
+        else {
+            func(this, 0, chunk_count);
+        }
+    }
+
+    static void HistogramJob(void *data, i32 begin, i32 end) {
+        RenderCommandBuffer *buffer = (RenderCommandBuffer *)data;
+        const u64 *from = buffer->sort_from;
+        i32 shift = DRAW_KEY_INDEX_BITS + buffer->sort_pass * DRAW_KEY_RADIX_BITS;
+
+        for (i32 chunk = begin; chunk < end; chunk++) {
+            u32 *histogram = buffer->histograms[chunk][buffer->sort_pass];
+            memset(histogram, 0, DRAW_KEY_RADIX_SIZE * sizeof(u32));
+
+            i32 first = chunk * buffer->chunk_size;
+            i32 last = HMM_MIN(buffer->count, first + buffer->chunk_size);
+            for (i32 i = first; i < last; i++) {
+                histogram[(from[i] >> shift) & (DRAW_KEY_RADIX_SIZE - 1)]++;
+            }
+        }
+    }
+
+    static void ScatterJob(void *data, i32 begin, i32 end) {
+        RenderCommandBuffer *buffer = (RenderCommandBuffer *)data;
+        const u64 *from = buffer->sort_from;
+        u64 *to = buffer->sort_to;
+        i32 shift = DRAW_KEY_INDEX_BITS + buffer->sort_pass * DRAW_KEY_RADIX_BITS;
+
+        for (i32 chunk = begin; chunk < end; chunk++) {
+            u32 *cursor = buffer->histograms[chunk][buffer->sort_pass];
+
+            i32 first = chunk * buffer->chunk_size;
+            i32 last = HMM_MIN(buffer->count, first + buffer->chunk_size);
+            if (buffer->count_next_pass) {
+                u32 *next = buffer->histograms[chunk][buffer->sort_pass + 1];
+                memset(next, 0, DRAW_KEY_RADIX_SIZE * sizeof(u32));
+                for (i32 i = first; i < last; i++) {
+                    u64 key = from[i];
+                    to[cursor[(key >> shift) & (DRAW_KEY_RADIX_SIZE - 1)]++] = key;
+                    next[(key >> (shift + DRAW_KEY_RADIX_BITS)) & (DRAW_KEY_RADIX_SIZE - 1)]++;
+                }
+            }
+            else {
+                for (i32 i = first; i < last; i++) {
+                    u64 key = from[i];
+                    to[cursor[(key >> shift) & (DRAW_KEY_RADIX_SIZE - 1)]++] = key;
+                }
+            }
+        }
+    }
+};
+
+// Lock-free triple buffer of command buffers, for one producer thread (the
+// simulation) and one consumer thread (the renderer). The producer fills one
+// buffer while the consumer draws another; the third holds the newest
+// finished frame, swapped in by whoever gets to it. Neither side ever waits.
+struct RenderSnapshots {
+    static constexpr u32 fresh_bit {4}; // on `latest` until the consumer took it
+
+    RenderCommandBuffer *buffers[3];
+    std::atomic<u32> latest {0};
+
+    u32 writing {1};   // producer only
+    u32 reading {2};   // consumer only
+    bool has_read {false};
+    bool fresh {false}; // consumer only: whether the last acquire() got a new frame
+
+
+    void init() {
+        for (i32 i = 0; i < 3; i++) {
+            buffers[i] = new RenderCommandBuffer();
+        }
+    }
+
+    RenderCommandBuffer *writeBuffer() {
+        return buffers[writing];
+    }
+
+    // Producer: the write buffer becomes the newest frame
+    void publish() {
+        writing = latest.exchange(writing | fresh_bit, std::memory_order_acq_rel) & ~fresh_bit;
+    }
+
+    // Whether the newest frame hasn't been picked up yet
+    bool pending() {
+        return latest.load(std::memory_order_acquire) & fresh_bit;
+    }
+
+    // Consumer: the newest frame, or the previous one again if nothing new was
+    // published since. Null until the first publish.
+    RenderCommandBuffer *acquire() {
+        fresh = pending();
+        if (fresh) {
+            reading = latest.exchange(reading, std::memory_order_acq_rel) & ~fresh_bit;
+            has_read = true;
+        }
+        return has_read ? buffers[reading] : nullptr;
+    }
+};
+
+typedef enum RenderBackendType {
+    RENDER_BACKEND_NULL = 0, // headless: counts what would have been drawn
+    RENDER_BACKEND_RAYLIB
+} render_backend_type;
+
+struct RenderStats {
+    i32 commands;
+    i32 culled;
+    i32 draw_calls;
+    i32 instances[MESH_COUNT];
+    i32 texts;
+
+    i32 static_vertices;   // drawn from the retained mesh
+    i32 static_uploads;    // static geometry re-uploads, since init
+};
+
+static const char *instancing_vs = R"(
+#version 330
+in vec3 vertexPosition;
+in mat4 instanceTransform;
+uniform mat4 mvp;
+void main() {
+    // The transforms are hmm_mat4s handed over as raylib Matrices, which arrive
+    // transposed: multiply from the left instead of transposing them back.
+    gl_Position = mvp * (vec4(vertexPosition, 1.0) * instanceTransform);
+}
+)";
+
+static const char *instancing_fs = R"(
+#version 330
+uniform vec4 colDiffuse;
+out vec4 finalColor;
+void main() {
+    finalColor = colDiffuse;
+}
+)";
+
+struct RenderBackend {
+    RenderBackendType type {RENDER_BACKEND_NULL};
+    RenderStats stats {}; // of the last submit
+    JobSystem *jobs {nullptr}; // for sorting, optional
+
+    // RENDER_BACKEND_RAYLIB only
+    Mesh meshes[MESH_COUNT];
+    Material material;
+
+    Mesh static_mesh {};
+    Material static_material;
+    u32 static_version {0}; // of the StaticGeometry in static_mesh
+    i32 static_uploads {0};
+
+    // Instance data of one run, in SoA for HMM_InstanceTransforms
+    f32 x[RenderCommandBuffer::max_commands];
+    f32 y[RenderCommandBuffer::max_commands];
+    f32 z[RenderCommandBuffer::max_commands];
+    f32 scale_x[RenderCommandBuffer::max_commands];
+    f32 scale_y[RenderCommandBuffer::max_commands];
+    f32 scale_z[RenderCommandBuffer::max_commands];
+    f32 yaw[RenderCommandBuffer::max_commands];
+    hmm_mat4 transforms[RenderCommandBuffer::max_commands];
+
+
+    void init(RenderBackendType backend_type, JobSystem *job_system) {
+        type = backend_type;
+        jobs = job_system;
+        if (type != RENDER_BACKEND_RAYLIB) return;
+
+        meshes[MESH_CUBE]   = GenMeshCube(1.0f, 1.0f, 1.0f);
+        meshes[MESH_SPHERE] = GenMeshSphere(1.0f, 16, 16);
+
+        Shader shader = LoadShaderFromMemory(instancing_vs, instancing_fs);
+        shader.locs[SHADER_LOC_MATRIX_MVP]   = GetShaderLocation(shader, "mvp");
+        shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(shader, "instanceTransform");
+
+        material = LoadMaterialDefault();
+        material.shader = shader;
+
+        static_material = LoadMaterialDefault();
+    }
+
+    void uploadStaticGeometry(StaticGeometry *geometry) {
+        static_version = geometry->version;
+        static_uploads++;
+        if (type != RENDER_BACKEND_RAYLIB) return;
+
+        if (static_mesh.vertexCount) {
+            UnloadMesh(static_mesh);
+        }
+
+        // raylib frees these on UnloadMesh, so they have to come from its allocator
+        i32 vertex_count = geometry->quad_count * 4;
+        static_mesh = {};
+        static_mesh.vertexCount = vertex_count;
+        static_mesh.triangleCount = geometry->quad_count * 2;
+        static_mesh.vertices = (f32 *)MemAlloc(vertex_count * 3 * sizeof(f32));
+        static_mesh.colors = (u8 *)MemAlloc(vertex_count * 4);
+        static_mesh.indices = (u16 *)MemAlloc(geometry->quad_count * 6 * sizeof(u16));
+        memcpy(static_mesh.vertices, geometry->vertices, vertex_count * 3 * sizeof(f32));
+        memcpy(static_mesh.colors, geometry->colors, vertex_count * 4);
+        for (i32 q = 0; q < geometry->quad_count; q++) {
+            u16 *quad = &static_mesh.indices[q * 6];
+            u16 first = (u16)(q * 4);
+            quad[0] = first; quad[1] = first + 1; quad[2] = first + 2;
+            quad[3] = first; quad[4] = first + 2; quad[5] = first + 3;
+        }
+        UploadMesh(&static_mesh, false);
+    }
+
+    // Sorts the buffer, then issues one draw per run of keys with equal state.
+    void submit(RenderCommandBuffer *buffer) {
+        buffer->sort(jobs);
+        u64 *keys = buffer->sorted_keys;
+        const u64 index_mask = (1ull << DRAW_KEY_INDEX_BITS) - 1;
+
+        stats = {};
+        stats.commands = buffer->count;
+        stats.culled = buffer->culled;
+        stats.texts = buffer->text_count;
+
+        StaticGeometry *geometry = buffer->has_static_geometry ? &buffer->static_geometry : nullptr;
+        if (geometry && geometry->version != static_version) {
+            uploadStaticGeometry(geometry);
+        }
+        stats.static_uploads = static_uploads;
+
+        if (type == RENDER_BACKEND_RAYLIB) {
+            DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), buffer->background);
+            BeginMode3D(buffer->camera);
+        }
+
+        if (geometry && geometry->quad_count) {
+            stats.draw_calls++;
+            stats.static_vertices = geometry->quad_count * 4;
+            if (type == RENDER_BACKEND_RAYLIB) {
+                Matrix identity = {1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1};
+                DrawMesh(static_mesh, static_material, identity);
+            }
+        }
+
+        i32 run_begin = 0;
+        while (run_begin < buffer->count) {
+            u64 state = keys[run_begin] >> DRAW_KEY_STATE_SHIFT;
+            RenderCommand *first = &buffer->commands[keys[run_begin] & index_mask];
+            // Colors past max_materials share a slot, a run of it ends where the color changes
+            bool shared = buffer->sharedMaterial((u8)(state & 0xFF));
+            i32 run_end = run_begin + 1;
+            while (run_end < buffer->count && (keys[run_end] >> DRAW_KEY_STATE_SHIFT) == state &&
+                   (!shared || ColorsEqual(buffer->commands[keys[run_end] & index_mask].color, first->color))) {
+                run_end++;
+            }
+
+            i32 instances = run_end - run_begin;
+            stats.draw_calls++;
+            stats.instances[first->mesh] += instances;
+
+            if (type == RENDER_BACKEND_RAYLIB) {
+                for (i32 i = 0; i < instances; i++) {
+                    RenderCommand *command = &buffer->commands[keys[run_begin + i] & index_mask];
+                    x[i] = command->position.x;
+                    y[i] = command->position.y;
+                    z[i] = command->position.z;
+                    scale_x[i] = command->scale.x;
+                    scale_y[i] = command->scale.y;
+                    scale_z[i] = command->scale.z;
+                    yaw[i] = command->yaw;
+                }
+                simd.instance_transforms(x, y, z, scale_x, scale_y, scale_z, yaw, instances, transforms);
+
+                material.maps[MATERIAL_MAP_DIFFUSE].color = first->color;
+                DrawMeshInstanced(meshes[first->mesh], material, (Matrix *)transforms, instances);
+            }
+
+            run_begin = run_end;
+        }
+
+        if (type == RENDER_BACKEND_RAYLIB) {
+            EndMode3D();
+
+            for (i32 i = 0; i < buffer->text_count; i++) {
+                RenderText *t = &buffer->texts[i];
+                DrawText(t->text, t->x, t->y, t->size, t->color);
+            }
+        }
+    }
+};
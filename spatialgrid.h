@@ -0,0 +1,96 @@
+#pragma once
+
+#include "vendor/raylib/include/raylib.h"
+#include "HandMadeMath.h"
+#include "defines.h"
+
+// Uniform grid over the arena, rebuilt every frame with a counting sort.
+// Items end up sorted by cell (row-major) in SoA arrays, so the cells
+// cx-1..cx+1 of one row are a single contiguous range that neighbour loops
+// can stream through 4 lanes at a time.
+//
+// Positions outside the grid are clamped into the border cells, so queries
+// stay correct (just slower) out there.
+
+struct SpatialGrid {
+    static constexpr i32 width  {104}; // cells
+    static constexpr i32 height {104}; // cells
+    static constexpr i32 cell_count {width * height};
+    static constexpr i32 max_items {1 << 17};
+
+    f32 cell_size {2.5f};
+    Vector3 origin {-130.0f, 0, -130.0f}; // world position of the corner of cell (0, 0)
+
+    i32 item_count {0};
+
+    // Items of cell c are sorted[cell_start[c] .. cell_start[c + 1])
+    u32 cell_start[cell_count + 1];
+
+    // Sorted by cell
+    alignas(16) f32 x[max_items];
+    alignas(16) f32 z[max_items];
+    alignas(16) f32 vx[max_items];
+    alignas(16) f32 vz[max_items];
+    u32 index[max_items]; // index the item was added with
+
+    // Staging, in the order items were added
+    f32 stage_x[max_items];
+    f32 stage_z[max_items];
+    f32 stage_vx[max_items];
+    f32 stage_vz[max_items];
+    u32 item_cell[max_items];
+
+
+    i32 cellX(f32 px) { return HMM_MAX(0, HMM_MIN(width  - 1, (i32)floorf((px - origin.x) / cell_size))); }
+    i32 cellZ(f32 pz) { return HMM_MAX(0, HMM_MIN(height - 1, (i32)floorf((pz - origin.z) / cell_size))); }
+
+    void clear(i32 count) {
+        item_count = HMM_MIN(count, max_items);
+        for (i32 c = 0; c <= cell_count; c++) {
+            cell_start[c] = 0;
+        }
+    }
+
+    // Call for every i in [0, count) given to clear()
+    void add(i32 i, f32 px, f32 pz, f32 vel_x, f32 vel_z) {
+        u32 cell = cellZ(pz) * width + cellX(px);
+        item_cell[i] = cell;
+        stage_x[i]  = px;
+        stage_z[i]  = pz;
+        stage_vx[i] = vel_x;
+        stage_vz[i] = vel_z;
+        cell_start[cell + 1]++;
+    }
+
+    void sort() {
+        for (i32 c = 0; c < cell_count; c++) {
+            cell_start[c + 1] += cell_start[c];
+        }
+
+        // Scatter, using the end of each cell's range as its running cursor
+        // and walking backwards to keep items in add order within a cell.
+        for (i32 i = item_count - 1; i >= 0; i--) {
+            u32 cell = item_cell[i];
+            u32 slot = --cell_start[cell + 1];
+            x[slot]  = stage_x[i];
+            z[slot]  = stage_z[i];
+            vx[slot] = stage_vx[i];
+            vz[slot] = stage_vz[i];
+            index[slot] = i;
+        }
+
+        // Every cursor walked back to the start of its cell, one slot up: shift down
+        for (i32 c = 0; c < cell_count; c++) {
+            cell_start[c] = cell_start[c + 1];
+        }
+        cell_start[cell_count] = item_count;
+    }
+
+    // Contiguous sorted range covering cells cx0..cx1 of row cz (clamped to the grid)
+    void rowRange(i32 cx0, i32 cx1, i32 cz, u32 *begin, u32 *end) {
+        cx0 = HMM_MAX(0, cx0);
+        cx1 = HMM_MIN(width - 1, cx1);
+        *begin = cell_start[cz * width + cx0];
+        *end   = cell_start[cz * width + cx1 + 1];
+    }
+};